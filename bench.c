@@ -0,0 +1,432 @@
+#include "io_helper.h"
+#include "request.h"
+#include "sched.h"
+#include "costmodel.h"
+#include "mempool.h"
+#include "mime.h"
+#include <pthread.h>
+#include <time.h>
+
+#define MAXBUF (8192)
+#define BENCH_REPEATS (5) // Repeticiones por prueba; se informa la mediana.
+#define BENCH_TARGET_NS (200000000.0) // Duración aproximada de cada repetición.
+
+typedef void (*bench_fn_t)(void *arg, long iters);
+
+/**
+ * @brief Lee el reloj monotónico en nanosegundos.
+ */
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Ejecuta una prueba y muestra la mediana de ns/op y ops/s.
+ * * Primero duplica el número de iteraciones hasta que una ejecución dura al
+ * menos 20 ms y luego lo ajusta para que cada repetición dure unos 200 ms,
+ * de modo que los resultados sean comparables entre ejecuciones.
+ *
+ * @param name El nombre de la prueba.
+ * @param fn La función que ejecuta iters operaciones.
+ * @param arg El argumento de la función.
+ */
+static void bench_run(const char *name, bench_fn_t fn, void *arg) {
+    long iters = 1;
+    double elapsed;
+
+    while (1) {
+        double start = bench_now_ns();
+        fn(arg, iters);
+        elapsed = bench_now_ns() - start;
+        if (elapsed >= BENCH_TARGET_NS / 10 || iters >= (1L << 30)) {
+            break;
+        }
+        iters *= 2;
+    }
+    iters = (long)(iters * (BENCH_TARGET_NS / elapsed));
+    if (iters < 1) {
+        iters = 1;
+    }
+
+    double ns_per_op[BENCH_REPEATS];
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        double start = bench_now_ns();
+        fn(arg, iters);
+        ns_per_op[r] = (bench_now_ns() - start) / iters;
+    }
+    qsort(ns_per_op, BENCH_REPEATS, sizeof(double), compare_double);
+    double median = ns_per_op[BENCH_REPEATS / 2];
+    printf("%-44s %12.1f %14.0f\n", name, median, 1e9 / median);
+    fflush(stdout);
+}
+
+// --- readline() ---
+
+static const char header_line[] = "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n";
+
+/**
+ * @brief Lee líneas de cabecera con readline_or_die() desde un socket.
+ * * Las líneas se escriben por bloques de 64 para que el coste medido sea el
+ * de readline() (una llamada a read() por byte) y no el de la escritura.
+ */
+static void bench_readline(void *arg, long iters) {
+    int *sv = (int *)arg;
+    char block[64 * sizeof(header_line)], buf[MAXBUF];
+    size_t line_len = strlen(header_line);
+
+    for (int i = 0; i < 64; i++) {
+        memcpy(block + i * line_len, header_line, line_len);
+    }
+    while (iters > 0) {
+        int n = iters < 64 ? (int)iters : 64;
+        write_or_die(sv[0], block, n * line_len);
+        for (int i = 0; i < n; i++) {
+            readline_or_die(sv[1], buf, MAXBUF);
+        }
+        iters -= n;
+    }
+}
+
+// --- Parseo de la petición ---
+
+static const char request_block[] = ""
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+    "Accept: text/html,application/xhtml+xml\r\n"
+    "Accept-Language: es-ES,es;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "If-None-Match: \"b68639a807d3c7a0\"\r\n"
+    "\r\n";
+
+/**
+ * @brief Lee y parsea una petición completa igual que request_handle():
+ * línea de petición con sscanf() y cabeceras con request_parse_headers().
+ */
+static void bench_parse_request(void *arg, long iters) {
+    int *sv = (int *)arg;
+    char buf[MAXBUF], method[MAXBUF], uri[MAXBUF], version[MAXBUF];
+    char h2_settings[MAXBUF], if_none_match[MAXBUF];
+    int accept_gzip;
+
+    for (long i = 0; i < iters; i++) {
+        write_or_die(sv[0], (void *)request_block, strlen(request_block));
+        readline_or_die(sv[1], buf, MAXBUF);
+        sscanf(buf, "%s %s %s", method, uri, version);
+        request_parse_headers(sv[1], h2_settings, &accept_gzip, if_none_match);
+    }
+}
+
+// --- mime_get_filetype() ---
+
+static void bench_filetype(void *arg, long iters) {
+    (void)arg;
+    static char *names[] = { "./index.html", "./styles.css", "./app.js", "./imagen.jpg", "./big.bin" };
+    char filetype[MAXBUF];
+
+    for (long i = 0; i < iters; i++) {
+        mime_get_filetype(names[i % 5], filetype);
+    }
+}
+
+// --- Selección en el búfer ---
+
+/**
+ * @brief Generador congruencial para tamaños de archivo reproducibles.
+ */
+static unsigned int bench_rand(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/**
+ * @brief Mide dequeue_request_locked() + enqueue_request_locked() con el
+ * búfer siempre lleno, de modo que SFF y SEJF recorren todas las entradas.
+ */
+static void bench_sched_select(void *arg, long iters) {
+    (void)arg;
+    unsigned int seed = 42;
+    request_entry_t entry;
+
+    memset(&entry, 0, sizeof(entry));
+    while (buffer_count_global < buffer_slots_global) {
+        entry.file_size_for_sff = bench_rand(&seed) % (1 << 20);
+        entry.expected_cost = entry.file_size_for_sff;
+        enqueue_request_locked(&entry);
+    }
+    for (long i = 0; i < iters; i++) {
+        dequeue_request_locked(&entry);
+        entry.file_size_for_sff = bench_rand(&seed) % (1 << 20);
+        entry.expected_cost = entry.file_size_for_sff;
+        enqueue_request_locked(&entry);
+    }
+}
+
+/**
+ * @brief Mide la estimación y el registro de una petición en el modelo de
+ * coste de SEJF, sobre 1024 URIs distintas.
+ */
+static void bench_costmodel(void *arg, long iters) {
+    (void)arg;
+    uint64_t keys[1024];
+    char uri[64];
+
+    for (int i = 0; i < 1024; i++) {
+        snprintf(uri, sizeof(uri), "/spin.cgi?%d", i);
+        keys[i] = costmodel_key(uri, 1);
+    }
+    for (long i = 0; i < iters; i++) {
+        uint64_t key = keys[i & 1023];
+        double cost = costmodel_predict(key, -1);
+        costmodel_observe(key, -1, 1, cost * 0.9 + 10);
+    }
+}
+
+// --- Memoria por petición ---
+
+/**
+ * @brief Reserva los ocho búferes de MAXBUF de una petición con malloc() y
+ * los libera, como hacía request_handle() antes de usar la arena.
+ */
+static void bench_malloc_request(void *arg, long iters) {
+    (void)arg;
+    char *bufs[8];
+
+    for (long i = 0; i < iters; i++) {
+        for (int j = 0; j < 8; j++) {
+            bufs[j] = malloc(MAXBUF);
+            bufs[j][0] = (char)j;
+        }
+        for (int j = 0; j < 8; j++) {
+            free(bufs[j]);
+        }
+    }
+}
+
+/**
+ * @brief Reserva los mismos búferes en la arena del hilo y la reinicia.
+ */
+static void bench_arena_request(void *arg, long iters) {
+    (void)arg;
+    arena_t *arena = arena_thread();
+
+    for (long i = 0; i < iters; i++) {
+        for (int j = 0; j < 8; j++) {
+            char *buf = arena_alloc(arena, MAXBUF);
+            buf[0] = (char)j;
+        }
+        arena_reset(arena);
+    }
+}
+
+/**
+ * @brief Obtiene y devuelve el búfer de lectura de una sesión HTTP/2.
+ */
+static void bench_pool_buffer(void *arg, long iters) {
+    (void)arg;
+
+    for (long i = 0; i < iters; i++) {
+        char *buf = pool_get(32768);
+        buf[0] = (char)i;
+        pool_put(buf, 32768);
+    }
+}
+
+// --- Búfer con contención ---
+
+typedef struct {
+    int producers;
+    int consumers;
+    long total; // Peticiones a pasar por el búfer en una ejecución.
+    long produced_per_thread;
+    long consumed;
+} contention_t;
+
+static void *contention_producer(void *arg) {
+    contention_t *c = (contention_t *)arg;
+    request_entry_t entry;
+
+    memset(&entry, 0, sizeof(entry));
+    for (long i = 0; i < c->produced_per_thread; i++) {
+        pthread_mutex_lock(&buffer_mutex_global);
+        while (buffer_count_global == buffer_slots_global) {
+            pthread_cond_wait(&buffer_not_full_cond, &buffer_mutex_global);
+        }
+        enqueue_request_locked(&entry);
+        pthread_cond_signal(&buffer_not_empty_cond);
+        pthread_mutex_unlock(&buffer_mutex_global);
+    }
+    return NULL;
+}
+
+static void *contention_consumer(void *arg) {
+    contention_t *c = (contention_t *)arg;
+    request_entry_t entry;
+
+    while (1) {
+        pthread_mutex_lock(&buffer_mutex_global);
+        while (!requests_available_locked() && c->consumed < c->total) {
+            pthread_cond_wait(&buffer_not_empty_cond, &buffer_mutex_global);
+        }
+        if (c->consumed == c->total) {
+            pthread_mutex_unlock(&buffer_mutex_global);
+            return NULL;
+        }
+        dequeue_request_locked(&entry);
+        if (++c->consumed == c->total) {
+            pthread_cond_broadcast(&buffer_not_empty_cond);
+        }
+        pthread_cond_signal(&buffer_not_full_cond);
+        pthread_mutex_unlock(&buffer_mutex_global);
+    }
+}
+
+/**
+ * @brief Productores y consumidores con el mismo protocolo de mutex y
+ * variables de condición que el maestro y los trabajadores del servidor.
+ */
+static void bench_contention(void *arg, long iters) {
+    contention_t *c = (contention_t *)arg;
+    pthread_t threads[16];
+    int n = 0;
+
+    c->produced_per_thread = (iters + c->producers - 1) / c->producers;
+    c->total = c->produced_per_thread * c->producers;
+    c->consumed = 0;
+    for (int i = 0; i < c->consumers; i++) {
+        pthread_create(&threads[n++], NULL, contention_consumer, c);
+    }
+    for (int i = 0; i < c->producers; i++) {
+        pthread_create(&threads[n++], NULL, contention_producer, c);
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// --- request_serve_static() ---
+
+typedef struct {
+    int sv[2];
+    char filename[MAXBUF];
+    int size;
+} serve_static_t;
+
+/**
+ * @brief Hilo que consume la respuesta, como haría el cliente.
+ */
+static void *serve_static_drain(void *arg) {
+    int fd = *(int *)arg;
+    char buf[65536];
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    return NULL;
+}
+
+static void bench_serve_static(void *arg, long iters) {
+    serve_static_t *s = (serve_static_t *)arg;
+    for (long i = 0; i < iters; i++) {
+        request_serve_static(s->sv[0], s->filename, s->size);
+    }
+}
+
+/**
+ * @brief Crea un archivo temporal del tamaño indicado para servirlo.
+ */
+static void serve_static_file(serve_static_t *s, int size) {
+    snprintf(s->filename, sizeof(s->filename), "/tmp/wbench-XXXXXX");
+    int fd = mkstemp(s->filename);
+    assert(fd >= 0);
+    char *data = malloc(size);
+    assert(data != NULL);
+    memset(data, 'x', size);
+    write_or_die(fd, data, size);
+    close_or_die(fd);
+    free(data);
+    s->size = size;
+}
+
+/**
+ * @brief Función principal de la batería de microbenchmarks.
+ * * Mide los componentes del camino crítico del servidor: readline(), el
+ * parseo de la petición, mime_get_filetype(), la selección de FIFO, SFF
+ * y SEJF con distintos tamaños de búfer, el modelo de coste de SEJF, el búfer compartido con contención entre
+ * hilos y request_serve_static() sobre un socketpair. Cada resultado es la
+ * mediana de varias repeticiones, en ns por operación y operaciones por
+ * segundo.
+ *
+ * @param argc El número de argumentos.
+ * @param argv El vector de argumentos.
+ * @return 0 en caso de éxito.
+ */
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+    int sv[2];
+    char name[MAXBUF];
+
+    printf("%-44s %12s %14s\n", "benchmark", "ns/op", "ops/s");
+
+    socketpair_or_die(AF_UNIX, SOCK_STREAM, 0, sv);
+    bench_run("readline (header line, 46 B)", bench_readline, sv);
+    bench_run("request line + request_parse_headers", bench_parse_request, sv);
+    close_or_die(sv[0]);
+    close_or_die(sv[1]);
+
+    bench_run("mime_get_filetype", bench_filetype, NULL);
+
+    int sizes[] = { 16, 256, 4096 };
+    const char *algs[] = { "FIFO", "SFF", "SEJF" };
+    for (int a = 0; a < 3; a++) {
+        for (int i = 0; i < 3; i++) {
+            if (sched_init(algs[a], sizes[i], 1, 1, 1, 0) < 0) {
+                exit(1);
+            }
+            snprintf(name, sizeof(name), "%s dequeue+enqueue, %d slots", algs[a], sizes[i]);
+            bench_run(name, bench_sched_select, NULL);
+            sched_destroy();
+        }
+    }
+    costmodel_init();
+    bench_run("costmodel_predict + costmodel_observe", bench_costmodel, NULL);
+
+    bench_run("malloc/free, 8 x 8 KiB", bench_malloc_request, NULL);
+    bench_run("arena_alloc + arena_reset, 8 x 8 KiB", bench_arena_request, NULL);
+    bench_run("pool_get + pool_put, 32 KiB", bench_pool_buffer, NULL);
+
+    int configs[][2] = { { 1, 1 }, { 1, 4 }, { 4, 4 } };
+    for (int i = 0; i < 3; i++) {
+        contention_t c = { .producers = configs[i][0], .consumers = configs[i][1] };
+        if (sched_init("FIFO", 16, c.consumers, 1, 1, 0) < 0) {
+            exit(1);
+        }
+        snprintf(name, sizeof(name), "buffer handoff, %d producer(s) x %d consumer(s)", c.producers, c.consumers);
+        bench_run(name, bench_contention, &c);
+        sched_destroy();
+    }
+
+    int file_sizes[] = { 1024, 64 * 1024, 1024 * 1024 };
+    const char *file_labels[] = { "1 KiB", "64 KiB", "1 MiB" };
+    for (int i = 0; i < 3; i++) {
+        serve_static_t s;
+        pthread_t drain;
+        serve_static_file(&s, file_sizes[i]);
+        socketpair_or_die(AF_UNIX, SOCK_STREAM, 0, s.sv);
+        pthread_create(&drain, NULL, serve_static_drain, &s.sv[1]);
+        snprintf(name, sizeof(name), "request_serve_static, %s", file_labels[i]);
+        bench_run(name, bench_serve_static, &s);
+        close_or_die(s.sv[0]);
+        pthread_join(drain, NULL);
+        close_or_die(s.sv[1]);
+        unlink(s.filename);
+    }
+    return 0;
+}
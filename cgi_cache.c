@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include "io_helper.h"
+#include "cgi_cache.h"
+#include "request.h"
+#include <pthread.h>
+#include <time.h>
+
+#define MAXBUF (8192)
+#define CGI_CACHE_BUCKETS (256)
+#define CGI_CACHE_MAX_ENTRIES (1024) // Respuestas guardadas como máximo.
+#define CGI_CACHE_MAX_SIZE (1024 * 1024) // Salidas mayores no se guardan.
+
+// Una respuesta de un CGI identificada por script + QUERY_STRING. Mientras
+// su primer solicitante ejecuta el programa la entrada está "pendiente" y
+// las peticiones idénticas esperan su salida en lugar de lanzar otro hijo.
+typedef struct cgi_cache_entry {
+    char *key; // "ruta?query".
+    char *data; // Salida completa del CGI (cabeceras incluidas), o NULL si falló.
+    size_t len; // Bytes en data.
+    struct timespec expires; // Instante (CLOCK_MONOTONIC) en que deja de ser válida.
+    int pending; // 1 mientras el CGI se está ejecutando.
+    int waiters; // Peticiones esperando a que termine la ejecución.
+    struct cgi_cache_entry *next; // Siguiente entrada del mismo cubo.
+} cgi_cache_entry_t;
+
+static int default_ttl_global = -1; // TTL en segundos (-1 = caché desactivada).
+static cgi_cache_entry_t *cache_buckets[CGI_CACHE_BUCKETS];
+static int cache_entries; // Entradas en la tabla, pendientes incluidas.
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_filled_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Hash FNV-1a de una clave.
+ */
+static unsigned int cgi_cache_hash(const char *key) {
+    unsigned int h = 2166136261u;
+    for (; *key; key++) {
+        h = (h ^ (unsigned char)*key) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Indica si una entrada ya no puede servirse. Requiere cache_mutex.
+ */
+static int cgi_cache_stale(const cgi_cache_entry_t *e, const struct timespec *now) {
+    if (e->pending) {
+        return 0;
+    }
+    return e->data == NULL || now->tv_sec > e->expires.tv_sec ||
+           (now->tv_sec == e->expires.tv_sec && now->tv_nsec >= e->expires.tv_nsec);
+}
+
+/**
+ * @brief Quita una entrada de su cubo y la libera. Requiere cache_mutex.
+ */
+static void cgi_cache_remove(cgi_cache_entry_t *e) {
+    cgi_cache_entry_t **pp = &cache_buckets[cgi_cache_hash(e->key) % CGI_CACHE_BUCKETS];
+    while (*pp != e) {
+        pp = &(*pp)->next;
+    }
+    *pp = e->next;
+    cache_entries--;
+    free(e->key);
+    free(e->data);
+    free(e);
+}
+
+/**
+ * @brief Libera las entradas caducadas que nadie está esperando. Requiere cache_mutex.
+ */
+static void cgi_cache_sweep(const struct timespec *now) {
+    for (int i = 0; i < CGI_CACHE_BUCKETS; i++) {
+        cgi_cache_entry_t *e = cache_buckets[i];
+        while (e != NULL) {
+            cgi_cache_entry_t *next = e->next;
+            if (e->waiters == 0 && cgi_cache_stale(e, now)) {
+                cgi_cache_remove(e);
+            }
+            e = next;
+        }
+    }
+}
+
+/**
+ * @brief Busca una entrada utilizable (vigente o pendiente). Requiere cache_mutex.
+ * * De paso libera las entradas caducadas del cubo que nadie espera; las que
+ * aún tienen peticiones esperando las libera la última en salir.
+ */
+static cgi_cache_entry_t *cgi_cache_lookup(const char *key, const struct timespec *now) {
+    cgi_cache_entry_t *e = cache_buckets[cgi_cache_hash(key) % CGI_CACHE_BUCKETS];
+    while (e != NULL) {
+        cgi_cache_entry_t *next = e->next;
+        if (strcmp(e->key, key) == 0) {
+            if (!cgi_cache_stale(e, now)) {
+                return e;
+            }
+            if (e->waiters == 0) {
+                cgi_cache_remove(e);
+            }
+        }
+        e = next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Devuelve una copia terminada en '\0' de la salida guardada. Requiere cache_mutex.
+ */
+static char *cgi_cache_copy(const cgi_cache_entry_t *e, size_t *out_len) {
+    char *copy = malloc(e->len + 1);
+    if (copy != NULL) {
+        memcpy(copy, e->data, e->len);
+        copy[e->len] = '\0';
+        *out_len = e->len;
+    }
+    return copy;
+}
+
+/**
+ * @brief Calcula durante cuántos segundos puede reutilizarse una salida.
+ * * Una cabecera Cache-Control emitida por el CGI tiene prioridad sobre el
+ * TTL configurado: "no-store", "no-cache" o "private" impiden guardar la
+ * respuesta y "max-age=N" fija el TTL en N segundos.
+ *
+ * @param out La salida completa del CGI, terminada en '\0'.
+ * @param len El tamaño de la salida.
+ * @return El TTL en segundos; 0 si la respuesta no debe guardarse.
+ */
+static int cgi_cache_ttl(const char *out, size_t len) {
+    char headers[MAXBUF];
+    const char *end = strstr(out, "\r\n\r\n");
+    size_t hlen = end ? (size_t)(end - out) : len;
+
+    if (len > CGI_CACHE_MAX_SIZE) {
+        return 0;
+    }
+    if (hlen >= sizeof(headers)) {
+        hlen = sizeof(headers) - 1;
+    }
+    memcpy(headers, out, hlen);
+    headers[hlen] = '\0';
+
+    char *cc = strcasestr(headers, "Cache-Control:");
+    if (cc == NULL) {
+        return default_ttl_global;
+    }
+    char *eol = strpbrk(cc, "\r\n");
+    if (eol != NULL) {
+        *eol = '\0';
+    }
+    if (strcasestr(cc, "no-store") || strcasestr(cc, "no-cache") || strcasestr(cc, "private")) {
+        return 0;
+    }
+    char *max_age = strcasestr(cc, "max-age=");
+    if (max_age != NULL) {
+        int ttl = atoi(max_age + strlen("max-age="));
+        return ttl > 0 ? ttl : 0;
+    }
+    return default_ttl_global;
+}
+
+/**
+ * @brief Activa la caché de respuestas de CGI para peticiones GET.
+ *
+ * @param default_ttl Segundos que se reutiliza una respuesta sin cabecera
+ * Cache-Control. Con 0 solo se guardan las respuestas con "max-age", aunque
+ * las peticiones idénticas simultáneas se siguen agrupando. Un valor negativo
+ * deja la caché desactivada.
+ */
+void cgi_cache_init(int default_ttl) {
+    default_ttl_global = default_ttl;
+}
+
+/**
+ * @brief Indica si la caché de CGI está activada.
+ */
+int cgi_cache_enabled(void) {
+    return default_ttl_global >= 0;
+}
+
+/**
+ * @brief Obtiene la salida de un CGI para una petición GET, usando la caché.
+ * * Si hay una respuesta vigente para el mismo script y QUERY_STRING se
+ * devuelve sin crear ningún proceso. Si otra petición idéntica está
+ * ejecutando ya el CGI, se espera a su salida (agrupación de peticiones).
+ * En otro caso se ejecuta el CGI con request_cgi_capture() y su salida se
+ * comparte con quienes esperan y se guarda durante su TTL.
+ *
+ * @param filename La ruta del script CGI.
+ * @param cgiargs Los argumentos de la query string.
+ * @param out_len Salida: el número de bytes devueltos.
+ * @return Un búfer reservado con malloc() con la salida completa del CGI,
+ * terminado en '\0', o NULL si el CGI no pudo ejecutarse.
+ */
+char *cgi_cache_get(char *filename, char *cgiargs, size_t *out_len) {
+    char key[2 * MAXBUF];
+    struct timespec now;
+    char *copy = NULL;
+
+    snprintf(key, sizeof(key), "%s?%s", filename, cgiargs);
+
+    pthread_mutex_lock(&cache_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    cgi_cache_entry_t *e = cgi_cache_lookup(key, &now);
+
+    if (e != NULL) {
+        if (e->pending) {
+            printf("[CGI CACHE] Esperando la ejecución en curso de %s\n", key);
+            e->waiters++;
+            while (e->pending) {
+                pthread_cond_wait(&cache_filled_cond, &cache_mutex);
+            }
+            e->waiters--;
+        } else {
+            printf("[CGI CACHE] Acierto: %s\n", key);
+        }
+        if (e->data != NULL) {
+            copy = cgi_cache_copy(e, out_len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (e->waiters == 0 && cgi_cache_stale(e, &now)) {
+            cgi_cache_remove(e);
+        }
+        pthread_mutex_unlock(&cache_mutex);
+        return copy;
+    }
+
+    if (cache_entries >= CGI_CACHE_MAX_ENTRIES) {
+        cgi_cache_sweep(&now);
+    }
+    if (cache_entries >= CGI_CACHE_MAX_ENTRIES) {
+        // Tabla llena de respuestas vigentes: se ejecuta sin caché.
+        pthread_mutex_unlock(&cache_mutex);
+        return request_cgi_capture(filename, cgiargs, NULL, 0, out_len);
+    }
+
+    e = (cgi_cache_entry_t *)calloc(1, sizeof(cgi_cache_entry_t));
+    assert(e != NULL);
+    e->key = strdup(key);
+    assert(e->key != NULL);
+    e->pending = 1;
+    unsigned int bucket = cgi_cache_hash(key) % CGI_CACHE_BUCKETS;
+    e->next = cache_buckets[bucket];
+    cache_buckets[bucket] = e;
+    cache_entries++;
+    pthread_mutex_unlock(&cache_mutex);
+
+    size_t len = 0;
+    char *out = request_cgi_capture(filename, cgiargs, NULL, 0, &len);
+    int ttl = out ? cgi_cache_ttl(out, len) : 0;
+
+    pthread_mutex_lock(&cache_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    e->data = out;
+    e->len = len;
+    e->expires = now;
+    e->expires.tv_sec += ttl;
+    e->pending = 0;
+    pthread_cond_broadcast(&cache_filled_cond);
+    printf("[CGI CACHE] Ejecutado %s (%d espera(n), TTL %d s)\n", key, e->waiters, ttl);
+
+    if (out != NULL) {
+        copy = cgi_cache_copy(e, out_len);
+    }
+    // Sin TTL la salida solo se comparte con las peticiones que ya esperaban.
+    if (e->waiters == 0 && cgi_cache_stale(e, &now)) {
+        cgi_cache_remove(e);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return copy;
+}
@@ -0,0 +1,10 @@
+#ifndef __CGI_CACHE_H__
+#define __CGI_CACHE_H__
+
+#include <stddef.h>
+
+void cgi_cache_init(int default_ttl);
+int cgi_cache_enabled(void);
+char *cgi_cache_get(char *filename, char *cgiargs, size_t *out_len);
+
+#endif // __CGI_CACHE_H__
@@ -0,0 +1,166 @@
+#include "io_helper.h"
+#include "costmodel.h"
+#include <pthread.h>
+
+#define COSTMODEL_SHARDS (64) // Cada fragmento tiene su propio mutex.
+#define COSTMODEL_SLOTS (256) // Entradas por fragmento; una colisión reemplaza la anterior.
+#define COSTMODEL_ALPHA (0.25) // Peso de la última muestra en la media móvil (EWMA).
+#define COSTMODEL_DECAY (0.995) // Olvido de las muestras antiguas en el ajuste por tamaño.
+
+// Estimaciones mientras no hay observaciones.
+#define COSTMODEL_DEFAULT_BASE_US (100.0)
+#define COSTMODEL_DEFAULT_US_PER_BYTE (0.001)
+#define COSTMODEL_DEFAULT_DYNAMIC_US (100000.0)
+
+// Tiempo de servicio medio de una URI.
+typedef struct {
+    uint64_t key; // 0 = entrada libre.
+    double ewma_us;
+} costmodel_entry_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    costmodel_entry_t slots[COSTMODEL_SLOTS];
+} costmodel_shard_t;
+
+static costmodel_shard_t shards[COSTMODEL_SHARDS];
+
+// Estimación para las URIs que aún no se han visto, protegida por fit_mutex.
+// El contenido estático se ajusta a base + bytes * pendiente por mínimos
+// cuadrados ponderados; el dinámico, sin tamaño, usa la media de todos los CGI.
+static pthread_mutex_t fit_mutex;
+static double fit_w, fit_x, fit_y, fit_xx, fit_xy; // Sumas ponderadas del ajuste.
+static double fit_base_us, fit_us_per_byte; // Resultado del ajuste.
+static double dynamic_ewma_us; // Media de las peticiones sin tamaño conocido.
+static int mutexes_ready;
+
+/**
+ * @brief Vacía el modelo y vuelve a las estimaciones por defecto.
+ * * El simulador la llama antes de cada política para que no compartan lo
+ * aprendido. No debe llamarse con trabajadores en marcha.
+ */
+void costmodel_init(void) {
+    if (!mutexes_ready) {
+        for (int i = 0; i < COSTMODEL_SHARDS; i++) {
+            pthread_mutex_init(&shards[i].mutex, NULL);
+        }
+        pthread_mutex_init(&fit_mutex, NULL);
+        mutexes_ready = 1;
+    }
+    for (int i = 0; i < COSTMODEL_SHARDS; i++) {
+        memset(shards[i].slots, 0, sizeof(shards[i].slots));
+    }
+    fit_w = fit_x = fit_y = fit_xx = fit_xy = 0;
+    fit_base_us = COSTMODEL_DEFAULT_BASE_US;
+    fit_us_per_byte = COSTMODEL_DEFAULT_US_PER_BYTE;
+    dynamic_ewma_us = COSTMODEL_DEFAULT_DYNAMIC_US;
+}
+
+/**
+ * @brief Calcula la clave de una URI (FNV-1a de 64 bits).
+ *
+ * @param uri La URI de la petición.
+ * @param is_dynamic 1 si la query string forma parte de la clave.
+ * @return La clave; nunca es 0.
+ */
+uint64_t costmodel_key(const char *uri, int is_dynamic) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const char *p = uri; *p != '\0' && (is_dynamic || *p != '?'); p++) {
+        h ^= (unsigned char)*p;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= (uint64_t)is_dynamic;
+    h *= 0x100000001b3ULL;
+    return h ? h : 1;
+}
+
+/**
+ * @brief Estima el tiempo de servicio de una petición.
+ * * Si la URI ya se ha visto se usa su media; si no, el ajuste por tamaño
+ * (contenido estático) o la media de las peticiones sin tamaño (CGI,
+ * HTTPS, archivos inexistentes).
+ *
+ * @param key La clave de costmodel_key(), o 0 si no se conoce la URI.
+ * @param size El tamaño de la respuesta, o un valor negativo si no se conoce.
+ * @return El tiempo estimado en microsegundos.
+ */
+double costmodel_predict(uint64_t key, off_t size) {
+    double cost = -1;
+
+    if (key != 0) {
+        costmodel_shard_t *shard = &shards[key % COSTMODEL_SHARDS];
+        costmodel_entry_t *e = &shard->slots[(key / COSTMODEL_SHARDS) % COSTMODEL_SLOTS];
+        pthread_mutex_lock(&shard->mutex);
+        if (e->key == key) {
+            cost = e->ewma_us;
+        }
+        pthread_mutex_unlock(&shard->mutex);
+        if (cost >= 0) {
+            return cost;
+        }
+    }
+
+    pthread_mutex_lock(&fit_mutex);
+    cost = size >= 0 ? fit_base_us + (double)size * fit_us_per_byte : dynamic_ewma_us;
+    pthread_mutex_unlock(&fit_mutex);
+    return cost;
+}
+
+/**
+ * @brief Recalcula el ajuste por tamaño. Requiere fit_mutex.
+ * * Si todas las muestras tienen casi el mismo tamaño la pendiente no se
+ * puede estimar y se conserva la de por defecto.
+ */
+static void costmodel_refit_locked(void) {
+    double det = fit_w * fit_xx - fit_x * fit_x;
+    double slope = COSTMODEL_DEFAULT_US_PER_BYTE;
+    if (det > 1e-9 * fit_w * fit_xx) {
+        slope = (fit_w * fit_xy - fit_x * fit_y) / det;
+        if (slope < 0) {
+            slope = 0;
+        }
+    }
+    double base = (fit_y - slope * fit_x) / fit_w;
+    fit_us_per_byte = slope;
+    fit_base_us = base > 0 ? base : 0;
+}
+
+/**
+ * @brief Registra el tiempo de servicio medido de una petición.
+ *
+ * * La media de las peticiones sin tamaño conocido solo aprende de los CGI:
+ * una petición estática sin tamaño (un 404, un método distinto de GET) es
+ * mucho más barata y la desviaría hacia abajo.
+ *
+ * @param key La clave de costmodel_key().
+ * @param size El tamaño de la respuesta, o un valor negativo si no se conoce.
+ * @param is_dynamic 1 si la petición era para un CGI.
+ * @param service_us El tiempo de servicio en microsegundos.
+ */
+void costmodel_observe(uint64_t key, off_t size, int is_dynamic, double service_us) {
+    costmodel_shard_t *shard = &shards[key % COSTMODEL_SHARDS];
+    costmodel_entry_t *e = &shard->slots[(key / COSTMODEL_SHARDS) % COSTMODEL_SLOTS];
+
+    pthread_mutex_lock(&shard->mutex);
+    if (e->key == key) {
+        e->ewma_us += COSTMODEL_ALPHA * (service_us - e->ewma_us);
+    } else {
+        e->key = key;
+        e->ewma_us = service_us;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    pthread_mutex_lock(&fit_mutex);
+    if (size >= 0) {
+        double x = (double)size;
+        fit_w = fit_w * COSTMODEL_DECAY + 1;
+        fit_x = fit_x * COSTMODEL_DECAY + x;
+        fit_y = fit_y * COSTMODEL_DECAY + service_us;
+        fit_xx = fit_xx * COSTMODEL_DECAY + x * x;
+        fit_xy = fit_xy * COSTMODEL_DECAY + x * service_us;
+        costmodel_refit_locked();
+    } else if (is_dynamic) {
+        dynamic_ewma_us += COSTMODEL_ALPHA * (service_us - dynamic_ewma_us);
+    }
+    pthread_mutex_unlock(&fit_mutex);
+}
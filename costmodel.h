@@ -0,0 +1,18 @@
+#ifndef __COSTMODEL_H__
+#define __COSTMODEL_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// --- Modelo de coste aprendido (política SEJF) ---
+// Los trabajadores registran el tiempo de servicio de cada petición y el
+// maestro lo usa para estimar el de las siguientes. Las claves son URIs:
+// sin la query string para el contenido estático y con ella para el
+// dinámico, de modo que spin.cgi?1 y spin.cgi?10 se aprenden por separado.
+
+void costmodel_init(void);
+uint64_t costmodel_key(const char *uri, int is_dynamic);
+double costmodel_predict(uint64_t key, off_t size);
+void costmodel_observe(uint64_t key, off_t size, int is_dynamic, double service_us);
+
+#endif // __COSTMODEL_H__
@@ -0,0 +1,502 @@
+#include "hpack.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Código Huffman de cada símbolo (RFC 7541, apéndice B), alineado a la derecha.
+static const unsigned int huffman_codes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+// Longitud en bits del código Huffman de cada símbolo.
+static const unsigned char huffman_lens[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+// Tabla estática de HPACK (RFC 7541, apéndice A). El índice 1 es la posición 0.
+static const char *static_table[61][2] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+// Árbol de decodificación Huffman. Cada nodo tiene dos hijos; un valor
+// positivo es el índice de otro nodo y uno negativo, -(símbolo + 1), una hoja.
+static short huffman_tree[512][2];
+static int huffman_nodes = 1;
+static pthread_once_t huffman_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Construye el árbol de decodificación Huffman a partir de la tabla de códigos.
+ */
+static void huffman_build(void) {
+    for (int sym = 0; sym < 256; sym++) {
+        int node = 0;
+        for (int bit = huffman_lens[sym] - 1; bit >= 0; bit--) {
+            int b = (huffman_codes[sym] >> bit) & 1;
+            if (bit == 0) {
+                huffman_tree[node][b] = (short)-(sym + 1);
+            } else {
+                if (huffman_tree[node][b] == 0) {
+                    huffman_tree[node][b] = (short)huffman_nodes++;
+                }
+                node = huffman_tree[node][b];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Decodifica una cadena codificada con Huffman.
+ *
+ * @param in Los bytes codificados.
+ * @param len La cantidad de bytes codificados.
+ * @param out Búfer de salida; debe tener espacio para len * 8 / 5 + 1 bytes.
+ * @return La longitud decodificada, o -1 si la cadena no es válida.
+ */
+static int huffman_decode(const unsigned char *in, size_t len, char *out) {
+    int node = 0, depth = 0, n = 0;
+
+    pthread_once(&huffman_once, huffman_build);
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            short next = huffman_tree[node][(in[i] >> bit) & 1];
+            depth++;
+            if (next < 0) {
+                out[n++] = (char)(-next - 1);
+                node = 0;
+                depth = 0;
+            } else if (next == 0) {
+                return -1;
+            } else {
+                node = next;
+            }
+        }
+    }
+    // El relleno final son como mucho 7 bits a 1 (prefijo del símbolo EOS).
+    if (depth > 7) {
+        return -1;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+/**
+ * @brief Decodifica un entero HPACK con un prefijo de N bits (RFC 7541, 5.1).
+ *
+ * @return El número de bytes consumidos, o -1 si el entero está truncado.
+ */
+static int hpack_decode_int(const unsigned char *p, size_t len, int prefix_bits, size_t *value) {
+    size_t max_prefix = (1u << prefix_bits) - 1;
+    size_t v;
+    int used = 1, shift = 0;
+
+    if (len < 1) {
+        return -1;
+    }
+    v = p[0] & max_prefix;
+    if (v < max_prefix) {
+        *value = v;
+        return used;
+    }
+    while ((size_t)used < len) {
+        unsigned char b = p[used++];
+        v += (size_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) {
+            *value = v;
+            return used;
+        }
+        if (shift > 28) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Decodifica un literal de cadena (RFC 7541, 5.2).
+ *
+ * @param out Salida: una cadena terminada en nulo reservada con malloc().
+ * @return El número de bytes consumidos, o -1 en caso de error.
+ */
+static int hpack_decode_string(const unsigned char *p, size_t len, char **out) {
+    size_t slen;
+    int used = hpack_decode_int(p, len, 7, &slen);
+
+    if (used < 0 || slen > len - used) {
+        return -1;
+    }
+    if (p[0] & 0x80) {
+        *out = malloc(slen * 8 / 5 + 2);
+        if (*out == NULL || huffman_decode(p + used, slen, *out) < 0) {
+            free(*out);
+            return -1;
+        }
+    } else {
+        *out = malloc(slen + 1);
+        if (*out == NULL) {
+            return -1;
+        }
+        memcpy(*out, p + used, slen);
+        (*out)[slen] = '\0';
+    }
+    return used + (int)slen;
+}
+
+/**
+ * @brief Expulsa las entradas más antiguas hasta que la tabla quepa en max_size.
+ */
+static void hpack_table_evict(hpack_table_t *t, size_t max_size) {
+    while (t->count > 0 && t->size > max_size) {
+        hpack_entry_t *e = &t->entries[t->count - 1];
+        t->size -= e->size;
+        free(e->name);
+        free(e->value);
+        t->count--;
+    }
+}
+
+/**
+ * @brief Inserta una cabecera en la tabla dinámica, tomando propiedad de las cadenas.
+ */
+static void hpack_table_add(hpack_table_t *t, char *name, char *value) {
+    size_t size = strlen(name) + strlen(value) + 32;
+
+    if (size > t->max_size) {
+        // Una entrada mayor que la tabla la vacía (RFC 7541, 4.4).
+        hpack_table_evict(t, 0);
+        free(name);
+        free(value);
+        return;
+    }
+    hpack_table_evict(t, t->max_size - size);
+    if (t->count == t->capacity) {
+        t->capacity = t->capacity ? t->capacity * 2 : 16;
+        t->entries = realloc(t->entries, sizeof(hpack_entry_t) * t->capacity);
+    }
+    memmove(&t->entries[1], &t->entries[0], sizeof(hpack_entry_t) * t->count);
+    t->entries[0].name = name;
+    t->entries[0].value = value;
+    t->entries[0].size = size;
+    t->count++;
+    t->size += size;
+}
+
+/**
+ * @brief Busca una entrada por su índice en el espacio combinado estático + dinámico.
+ *
+ * @return 0 en caso de éxito, -1 si el índice no existe.
+ */
+static int hpack_table_lookup(hpack_table_t *t, size_t index, const char **name, const char **value) {
+    if (index == 0) {
+        return -1;
+    }
+    if (index <= 61) {
+        *name = static_table[index - 1][0];
+        *value = static_table[index - 1][1];
+        return 0;
+    }
+    index -= 62;
+    if (index >= (size_t)t->count) {
+        return -1;
+    }
+    *name = t->entries[index].name;
+    *value = t->entries[index].value;
+    return 0;
+}
+
+/**
+ * @brief Inicializa una tabla dinámica vacía.
+ *
+ * @param t La tabla.
+ * @param max_size El tamaño máximo inicial (4096 según la RFC).
+ */
+void hpack_table_init(hpack_table_t *t, size_t max_size) {
+    t->entries = NULL;
+    t->count = 0;
+    t->capacity = 0;
+    t->size = 0;
+    t->max_size = max_size;
+}
+
+/**
+ * @brief Libera todas las entradas de una tabla dinámica.
+ */
+void hpack_table_free(hpack_table_t *t) {
+    hpack_table_evict(t, 0);
+    free(t->entries);
+    t->entries = NULL;
+    t->capacity = 0;
+}
+
+/**
+ * @brief Decodifica un bloque de cabeceras HPACK completo.
+ * * Actualiza la tabla dinámica según las representaciones del bloque e invoca
+ * on_header una vez por cada cabecera, en orden.
+ *
+ * @param t La tabla dinámica del sentido cliente -> servidor.
+ * @param block El bloque de cabeceras (concatenación de HEADERS y CONTINUATION).
+ * @param len La longitud del bloque.
+ * @param on_header Función que recibe cada cabecera decodificada.
+ * @param ctx Contexto que se pasa a on_header.
+ * @return 0 en caso de éxito, -1 si el bloque no es válido (COMPRESSION_ERROR).
+ */
+int hpack_decode(hpack_table_t *t, const unsigned char *block, size_t len, hpack_header_cb on_header, void *ctx) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        const unsigned char *p = block + pos;
+        size_t left = len - pos;
+        size_t index;
+        int used;
+
+        if (p[0] & 0x80) {
+            // Campo indexado.
+            const char *name, *value;
+            used = hpack_decode_int(p, left, 7, &index);
+            if (used < 0 || hpack_table_lookup(t, index, &name, &value) < 0) {
+                return -1;
+            }
+            on_header(ctx, name, value);
+            pos += used;
+            continue;
+        }
+
+        if ((p[0] & 0xe0) == 0x20) {
+            // Actualización del tamaño de la tabla dinámica.
+            used = hpack_decode_int(p, left, 5, &index);
+            if (used < 0 || index > 4096) {
+                return -1;
+            }
+            t->max_size = index;
+            hpack_table_evict(t, t->max_size);
+            pos += used;
+            continue;
+        }
+
+        // Literal con indexado incremental (01), sin indexar (0000) o
+        // nunca indexado (0001).
+        int incremental = (p[0] & 0xc0) == 0x40;
+        int prefix_bits = incremental ? 6 : 4;
+        char *name = NULL, *value = NULL;
+
+        used = hpack_decode_int(p, left, prefix_bits, &index);
+        if (used < 0) {
+            return -1;
+        }
+        pos += used;
+        if (index > 0) {
+            const char *idx_name, *idx_value;
+            if (hpack_table_lookup(t, index, &idx_name, &idx_value) < 0) {
+                return -1;
+            }
+            name = strdup(idx_name);
+        } else {
+            used = hpack_decode_string(block + pos, len - pos, &name);
+            if (used < 0) {
+                return -1;
+            }
+            pos += used;
+        }
+        used = hpack_decode_string(block + pos, len - pos, &value);
+        if (used < 0) {
+            free(name);
+            return -1;
+        }
+        pos += used;
+
+        on_header(ctx, name, value);
+        if (incremental) {
+            hpack_table_add(t, name, value);
+        } else {
+            free(name);
+            free(value);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Codifica un entero HPACK con un prefijo de N bits.
+ *
+ * @return El número de bytes escritos, o 0 si no cabe en el búfer.
+ */
+static size_t hpack_encode_int(unsigned char *out, size_t cap, unsigned char first, int prefix_bits, size_t value) {
+    size_t max_prefix = (1u << prefix_bits) - 1;
+    size_t n = 0;
+
+    if (cap < 1) {
+        return 0;
+    }
+    if (value < max_prefix) {
+        out[n++] = first | (unsigned char)value;
+        return n;
+    }
+    out[n++] = first | (unsigned char)max_prefix;
+    value -= max_prefix;
+    while (value >= 0x80) {
+        if (n >= cap) {
+            return 0;
+        }
+        out[n++] = (unsigned char)(value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    if (n >= cap) {
+        return 0;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+/**
+ * @brief Codifica un literal de cadena sin Huffman.
+ */
+static size_t hpack_encode_string(unsigned char *out, size_t cap, const char *s) {
+    size_t slen = strlen(s);
+    size_t n = hpack_encode_int(out, cap, 0x00, 7, slen);
+
+    if (n == 0 || slen > cap - n) {
+        return 0;
+    }
+    memcpy(out + n, s, slen);
+    return n + slen;
+}
+
+/**
+ * @brief Codifica una cabecera como literal sin indexar (RFC 7541, 6.2.2).
+ * * El servidor no usa la tabla dinámica al codificar, así que el cliente no
+ * necesita mantener estado para las respuestas.
+ *
+ * @param out Búfer de salida.
+ * @param cap Espacio disponible en out.
+ * @param name_index Índice de la tabla estática para el nombre, o 0 para
+ * enviar el nombre como literal.
+ * @param name El nombre (en minúsculas); solo se usa si name_index es 0.
+ * @param value El valor de la cabecera.
+ * @return El número de bytes escritos, o 0 si no cabe en el búfer.
+ */
+size_t hpack_encode_header(unsigned char *out, size_t cap, int name_index, const char *name, const char *value) {
+    size_t n = hpack_encode_int(out, cap, 0x00, 4, name_index);
+    size_t m;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (name_index == 0) {
+        m = hpack_encode_string(out + n, cap - n, name);
+        if (m == 0) {
+            return 0;
+        }
+        n += m;
+    }
+    m = hpack_encode_string(out + n, cap - n, value);
+    if (m == 0) {
+        return 0;
+    }
+    return n + m;
+}
@@ -0,0 +1,36 @@
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <stddef.h>
+
+// Entrada de la tabla dinámica de HPACK (RFC 7541, sección 2.3.2).
+typedef struct {
+    char *name;
+    char *value;
+    size_t size; // Tamaño según la RFC: len(name) + len(value) + 32.
+} hpack_entry_t;
+
+// Tabla dinámica de un sentido de la conexión. La entrada más reciente está
+// en la posición 0.
+typedef struct {
+    hpack_entry_t *entries;
+    int count;
+    int capacity;
+    size_t size; // Suma de los tamaños de las entradas.
+    size_t max_size; // Tamaño máximo anunciado por SETTINGS_HEADER_TABLE_SIZE.
+} hpack_table_t;
+
+typedef void (*hpack_header_cb)(void *ctx, const char *name, const char *value);
+
+void hpack_table_init(hpack_table_t *t, size_t max_size);
+void hpack_table_free(hpack_table_t *t);
+int hpack_decode(hpack_table_t *t, const unsigned char *block, size_t len, hpack_header_cb on_header, void *ctx);
+size_t hpack_encode_header(unsigned char *out, size_t cap, int name_index, const char *name, const char *value);
+
+// Índices de la tabla estática usados al codificar respuestas.
+#define HPACK_STATIC_STATUS (8)
+#define HPACK_STATIC_CONTENT_LENGTH (28)
+#define HPACK_STATIC_CONTENT_TYPE (31)
+#define HPACK_STATIC_SERVER (54)
+
+#endif // __HPACK_H__
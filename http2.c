@@ -0,0 +1,1181 @@
+#define _GNU_SOURCE
+#include "io_helper.h"
+#include "http2.h"
+#include "hpack.h"
+#include "request.h"
+#include "cgi_cache.h"
+#include "pack.h"
+#include "mempool.h"
+#include "plugin.h"
+#include "mime.h"
+#include <pthread.h>
+#include <poll.h>
+#include <stdint.h>
+
+#define MAXBUF (8192)
+
+// Tipos de frame (RFC 7540, sección 6).
+#define H2_DATA (0x0)
+#define H2_HEADERS (0x1)
+#define H2_PRIORITY (0x2)
+#define H2_RST_STREAM (0x3)
+#define H2_SETTINGS (0x4)
+#define H2_PUSH_PROMISE (0x5)
+#define H2_PING (0x6)
+#define H2_GOAWAY (0x7)
+#define H2_WINDOW_UPDATE (0x8)
+#define H2_CONTINUATION (0x9)
+
+// Banderas de frame.
+#define H2_FLAG_END_STREAM (0x1)
+#define H2_FLAG_ACK (0x1)
+#define H2_FLAG_END_HEADERS (0x4)
+#define H2_FLAG_PADDED (0x8)
+#define H2_FLAG_PRIORITY (0x20)
+
+// Parámetros de SETTINGS.
+#define H2_SETTINGS_HEADER_TABLE_SIZE (0x1)
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS (0x3)
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE (0x4)
+#define H2_SETTINGS_MAX_FRAME_SIZE (0x5)
+
+// Códigos de error.
+#define H2_NO_ERROR (0x0)
+#define H2_PROTOCOL_ERROR (0x1)
+#define H2_FLOW_CONTROL_ERROR (0x3)
+#define H2_FRAME_SIZE_ERROR (0x6)
+#define H2_REFUSED_STREAM (0x7)
+#define H2_COMPRESSION_ERROR (0x9)
+
+#define H2_FRAME_HEADER_LEN (9)
+#define H2_DEFAULT_WINDOW (65535)
+#define H2_MAX_FRAME (16384) // Tamaño máximo de frame que acepta el servidor.
+#define H2_MAX_STREAMS (100) // Streams concurrentes por conexión.
+#define H2_MAX_HEADER_BLOCK (65536) // Tamaño máximo de un bloque de cabeceras.
+#define H2_MAX_BODY (1024 * 1024) // Tamaño máximo del cuerpo de una petición.
+#define H2_IDLE_TIMEOUT_MS (60000) // Cierre de conexiones inactivas sin streams.
+
+typedef struct h2_session h2_session_t;
+
+// Un stream es la unidad que se encola y planifica: cada petición de una
+// conexión multiplexada pasa por el búfer compartido por separado.
+struct h2_stream {
+    uint32_t id; // Identificador del stream.
+    h2_session_t *session; // Conexión a la que pertenece.
+    char method[16]; // :method
+    char *path; // :path
+    int accept_gzip; // 1 si accept-encoding incluye gzip.
+    char *if_none_match; // if-none-match, o NULL.
+    char *body; // Cuerpo de la petición (POST).
+    size_t body_len;
+    int dispatched; // 1 si ya se entregó a los trabajadores.
+    int cancelled; // 1 si el cliente lo canceló con RST_STREAM.
+
+    // Respuesta preparada por el trabajador. Una vez publicada solo la usa
+    // el hilo de la sesión.
+    int responded; // 1 si el hilo de la sesión ya recogió la respuesta.
+    unsigned char *resp_headers; // Bloque HPACK de cabeceras.
+    size_t resp_headers_len;
+    char *resp_body; // Cuerpo de la respuesta.
+    size_t resp_len;
+    int resp_mapped; // 1 si resp_body es una región de mmap().
+    int resp_borrowed; // 1 si resp_body apunta al paquete de contenido.
+    int headers_sent; // 1 si ya se envió el frame HEADERS.
+    size_t resp_sent; // Bytes del cuerpo ya enviados.
+    int64_t send_window; // Ventana de control de flujo de envío del stream.
+
+    h2_stream_t *next; // Lista de streams de la sesión.
+    h2_stream_t *next_done; // Lista de respuestas publicadas por trabajadores.
+};
+
+// Estado de una conexión HTTP/2. Un único hilo por conexión lee los frames
+// y escribe todas las respuestas; los trabajadores solo preparan respuestas.
+struct h2_session {
+    int fd; // Socket de la conexión.
+    pthread_mutex_t mutex; // Protege in_worker y done_head.
+    pthread_cond_t idle_cond; // Se señala cuando in_worker llega a 0.
+    int wake_pipe[2]; // Avisa al hilo de la sesión de respuestas nuevas.
+    int in_worker; // Streams que están siendo procesados por trabajadores.
+    h2_stream_t *done_head; // Respuestas publicadas pendientes de enviar.
+
+    hpack_table_t decoder; // Tabla dinámica cliente -> servidor.
+    h2_stream_t *streams; // Streams abiertos.
+    int open_streams; // Número de streams abiertos.
+    int64_t conn_send_window; // Ventana de envío de la conexión.
+    int64_t initial_window; // SETTINGS_INITIAL_WINDOW_SIZE del cliente.
+    uint32_t peer_max_frame; // SETTINGS_MAX_FRAME_SIZE del cliente.
+    uint32_t last_stream_id; // Último stream iniciado por el cliente.
+    int goaway; // 1 si el cliente envió GOAWAY o el servidor se está apagando.
+    h2_session_t *next_live; // Lista de sesiones vivas (live_sessions).
+
+    unsigned char *rbuf; // Datos recibidos aún no procesados.
+    size_t rlen, rcap;
+    unsigned char *hblock; // Bloque de cabeceras en construcción.
+    size_t hblock_len;
+    uint32_t hblock_stream; // Stream del bloque en construcción (0 = ninguno).
+    int hblock_end_stream; // END_STREAM del frame HEADERS inicial.
+};
+
+// Encola un stream en el búfer compartido del servidor (wserver.c).
+static void (*stream_enqueue_global)(h2_stream_t *, off_t, int);
+
+// Sesiones vivas, para poder cerrarlas al apagar el servidor.
+static h2_session_t *live_sessions;
+static int live_session_count;
+static int draining_global; // 1 tras http2_drain().
+static pthread_mutex_t live_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Añade una sesión a la lista de sesiones vivas.
+ */
+static void h2_session_register(h2_session_t *sess) {
+    pthread_mutex_lock(&live_mutex);
+    sess->next_live = live_sessions;
+    live_sessions = sess;
+    live_session_count++;
+    pthread_mutex_unlock(&live_mutex);
+}
+
+/**
+ * @brief Quita una sesión de la lista de sesiones vivas.
+ */
+static void h2_session_unregister(h2_session_t *sess) {
+    pthread_mutex_lock(&live_mutex);
+    for (h2_session_t **pp = &live_sessions; *pp != NULL; pp = &(*pp)->next_live) {
+        if (*pp == sess) {
+            *pp = sess->next_live;
+            live_session_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&live_mutex);
+}
+
+/**
+ * @brief Pide a todas las sesiones que terminen.
+ * * Cada sesión envía GOAWAY, termina los streams que ya tiene abiertos y
+ * se cierra. Las sesiones que empiecen después se cierran igual.
+ */
+void http2_drain(void) {
+    char c = 0;
+
+    pthread_mutex_lock(&live_mutex);
+    __atomic_store_n(&draining_global, 1, __ATOMIC_RELAXED);
+    for (h2_session_t *sess = live_sessions; sess != NULL; sess = sess->next_live) {
+        if (write(sess->wake_pipe[1], &c, 1) < 0 && errno != EAGAIN) {
+            perror("write(wake_pipe)");
+        }
+    }
+    pthread_mutex_unlock(&live_mutex);
+}
+
+/**
+ * @brief Devuelve el número de sesiones HTTP/2 abiertas.
+ */
+int http2_active_sessions(void) {
+    pthread_mutex_lock(&live_mutex);
+    int n = live_session_count;
+    pthread_mutex_unlock(&live_mutex);
+    return n;
+}
+
+/**
+ * @brief Configura la función que entrega los streams a los trabajadores.
+ *
+ * @param enqueue Función que encola un stream con su tamaño estimado (para
+ * SFF) y su clase (para CLASS). Puede bloquearse si el búfer está lleno.
+ */
+void http2_init(void (*enqueue)(h2_stream_t *stream, off_t size_for_sff, int is_dynamic)) {
+    stream_enqueue_global = enqueue;
+}
+
+/**
+ * @brief Lee un entero de 32 bits en orden de red.
+ */
+static uint32_t h2_get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Escribe todos los bytes en el socket de la conexión.
+ *
+ * @return 0 en caso de éxito, -1 si el cliente cerró la conexión.
+ */
+static int h2_send_all(int fd, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t rc = send(fd, buf, len, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+/**
+ * @brief Envía un frame con su cabecera de 9 bytes.
+ *
+ * @return 0 en caso de éxito, -1 si el cliente cerró la conexión.
+ */
+static int h2_send_frame(h2_session_t *sess, int type, int flags, uint32_t stream_id,
+                         const unsigned char *payload, size_t len) {
+    unsigned char hdr[H2_FRAME_HEADER_LEN];
+
+    hdr[0] = (len >> 16) & 0xff;
+    hdr[1] = (len >> 8) & 0xff;
+    hdr[2] = len & 0xff;
+    hdr[3] = type;
+    hdr[4] = flags;
+    hdr[5] = (stream_id >> 24) & 0x7f;
+    hdr[6] = (stream_id >> 16) & 0xff;
+    hdr[7] = (stream_id >> 8) & 0xff;
+    hdr[8] = stream_id & 0xff;
+    if (h2_send_all(sess->fd, hdr, sizeof(hdr)) < 0) {
+        return -1;
+    }
+    return len > 0 ? h2_send_all(sess->fd, payload, len) : 0;
+}
+
+/**
+ * @brief Envía un frame con un único entero de 32 bits como carga útil.
+ */
+static int h2_send_u32_frame(h2_session_t *sess, int type, uint32_t stream_id, uint32_t value) {
+    unsigned char p[4] = { value >> 24, (value >> 16) & 0xff, (value >> 8) & 0xff, value & 0xff };
+    return h2_send_frame(sess, type, 0, stream_id, p, sizeof(p));
+}
+
+/**
+ * @brief Envía GOAWAY con el último stream procesado y un código de error.
+ */
+static void h2_send_goaway(h2_session_t *sess, uint32_t error) {
+    unsigned char p[8];
+    uint32_t last = sess->last_stream_id;
+
+    p[0] = (last >> 24) & 0x7f;
+    p[1] = (last >> 16) & 0xff;
+    p[2] = (last >> 8) & 0xff;
+    p[3] = last & 0xff;
+    p[4] = error >> 24;
+    p[5] = (error >> 16) & 0xff;
+    p[6] = (error >> 8) & 0xff;
+    p[7] = error & 0xff;
+    h2_send_frame(sess, H2_GOAWAY, 0, 0, p, sizeof(p));
+}
+
+/**
+ * @brief Busca un stream abierto por su identificador.
+ */
+static h2_stream_t *h2_find_stream(h2_session_t *sess, uint32_t id) {
+    for (h2_stream_t *s = sess->streams; s != NULL; s = s->next) {
+        if (s->id == id) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Libera la respuesta de un stream.
+ */
+static void h2_stream_free_response(h2_stream_t *s) {
+    if (s->resp_body != NULL && !s->resp_borrowed) {
+        if (s->resp_mapped) {
+            munmap_or_die(s->resp_body, s->resp_len);
+        } else {
+            free(s->resp_body);
+        }
+    }
+    pool_put(s->resp_headers, MAXBUF);
+    s->resp_body = NULL;
+    s->resp_headers = NULL;
+}
+
+/**
+ * @brief Retira un stream de la sesión y libera su memoria.
+ * * No debe llamarse mientras un trabajador procesa el stream.
+ */
+static void h2_stream_destroy(h2_session_t *sess, h2_stream_t *s) {
+    h2_stream_t **pp = &sess->streams;
+    while (*pp != s) {
+        pp = &(*pp)->next;
+    }
+    *pp = s->next;
+    sess->open_streams--;
+
+    h2_stream_free_response(s);
+    free(s->path);
+    free(s->if_none_match);
+    free(s->body);
+    free(s);
+}
+
+/**
+ * @brief Crea un stream nuevo iniciado por el cliente.
+ */
+static h2_stream_t *h2_stream_create(h2_session_t *sess, uint32_t id) {
+    h2_stream_t *s = calloc(1, sizeof(h2_stream_t));
+    assert(s != NULL);
+    s->id = id;
+    s->session = sess;
+    s->send_window = sess->initial_window;
+    s->next = sess->streams;
+    sess->streams = s;
+    sess->open_streams++;
+    if (id > sess->last_stream_id) {
+        sess->last_stream_id = id;
+    }
+    return s;
+}
+
+/**
+ * @brief Estima el tamaño de la petición de un stream con el mismo criterio
+ * que get_sff_filesize_peek() en wserver.c.
+ *
+ * @param s El stream.
+ * @param is_dynamic Salida: 1 si la petición es para un CGI o un plugin.
+ * @return El tamaño del archivo solicitado, o -1 si no existe.
+ */
+static off_t h2_stream_estimate(h2_stream_t *s, int *is_dynamic) {
+    char uri[MAXBUF], filename[MAXBUF], cgiargs[MAXBUF];
+    struct stat sbuf;
+
+    snprintf(uri, MAXBUF, "%s", s->path ? s->path : "/");
+    if (plugin_match(uri) >= 0) {
+        *is_dynamic = 1;
+        return -1;
+    }
+    *is_dynamic = !request_parse_uri(uri, filename, cgiargs);
+    if (!*is_dynamic && pack_loaded()) {
+        const pack_entry_t *entry = pack_lookup(filename);
+        return entry ? (off_t)entry->data_size : -1;
+    }
+    if (strstr(uri, "..") || stat(filename, &sbuf) < 0) {
+        return -1;
+    }
+    return sbuf.st_size;
+}
+
+/**
+ * @brief Entrega a los trabajadores un stream cuya petición está completa.
+ */
+static void h2_stream_dispatch(h2_session_t *sess, h2_stream_t *s) {
+    int is_dynamic;
+    off_t size = h2_stream_estimate(s, &is_dynamic);
+
+    s->dispatched = 1;
+    pthread_mutex_lock(&sess->mutex);
+    sess->in_worker++;
+    pthread_mutex_unlock(&sess->mutex);
+
+    printf("[HTTP2 FD=%d] Stream %u encolado: %s %s\n", sess->fd, s->id, s->method, s->path ? s->path : "");
+    stream_enqueue_global(s, size, is_dynamic);
+}
+
+/**
+ * @brief Recibe cada cabecera decodificada de una petición.
+ */
+static void h2_on_header(void *ctx, const char *name, const char *value) {
+    h2_stream_t *s = (h2_stream_t *)ctx;
+
+    if (s == NULL) {
+        return;
+    }
+    if (strcmp(name, ":method") == 0) {
+        snprintf(s->method, sizeof(s->method), "%s", value);
+    } else if (strcmp(name, ":path") == 0 && s->path == NULL) {
+        s->path = strdup(value);
+    } else if (strcmp(name, "accept-encoding") == 0) {
+        s->accept_gzip = strcasestr(value, "gzip") != NULL;
+    } else if (strcmp(name, "if-none-match") == 0 && s->if_none_match == NULL) {
+        s->if_none_match = strdup(value);
+    }
+}
+
+/**
+ * @brief Aplica una lista de parámetros de SETTINGS enviada por el cliente.
+ *
+ * @return 0 en caso de éxito, o un código de error HTTP/2.
+ */
+static uint32_t h2_apply_settings(h2_session_t *sess, const unsigned char *p, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        int id = (p[i] << 8) | p[i + 1];
+        uint32_t value = h2_get32(p + i + 2);
+
+        if (id == H2_SETTINGS_INITIAL_WINDOW_SIZE) {
+            if (value > 0x7fffffff) {
+                return H2_FLOW_CONTROL_ERROR;
+            }
+            // El cambio afecta a la ventana de todos los streams abiertos.
+            int64_t delta = (int64_t)value - sess->initial_window;
+            for (h2_stream_t *s = sess->streams; s != NULL; s = s->next) {
+                s->send_window += delta;
+            }
+            sess->initial_window = value;
+        } else if (id == H2_SETTINGS_MAX_FRAME_SIZE) {
+            if (value < 16384 || value > 16777215) {
+                return H2_PROTOCOL_ERROR;
+            }
+            sess->peer_max_frame = value;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Procesa un bloque de cabeceras completo (HEADERS + CONTINUATION).
+ *
+ * @return 0 en caso de éxito, o un código de error de conexión.
+ */
+static uint32_t h2_finish_header_block(h2_session_t *sess) {
+    uint32_t id = sess->hblock_stream;
+    h2_stream_t *s = h2_find_stream(sess, id);
+    int is_new = 0;
+
+    sess->hblock_stream = 0;
+    if (s == NULL) {
+        if (id <= sess->last_stream_id) {
+            // Cabeceras para un stream ya cerrado: se decodifican solo para
+            // mantener sincronizada la tabla dinámica.
+            return hpack_decode(&sess->decoder, sess->hblock, sess->hblock_len, h2_on_header, NULL) < 0
+                       ? H2_COMPRESSION_ERROR : 0;
+        }
+        s = h2_stream_create(sess, id);
+        is_new = 1;
+    }
+
+    if (hpack_decode(&sess->decoder, sess->hblock, sess->hblock_len, h2_on_header, is_new ? s : NULL) < 0) {
+        return H2_COMPRESSION_ERROR;
+    }
+
+    if (is_new && sess->open_streams > H2_MAX_STREAMS) {
+        h2_send_u32_frame(sess, H2_RST_STREAM, id, H2_REFUSED_STREAM);
+        h2_stream_destroy(sess, s);
+        return 0;
+    }
+
+    if (sess->hblock_end_stream && !s->dispatched) {
+        h2_stream_dispatch(sess, s);
+    }
+    return 0;
+}
+
+/**
+ * @brief Procesa un frame recibido.
+ *
+ * @return 0 en caso de éxito, o un código de error de conexión.
+ */
+static uint32_t h2_handle_frame(h2_session_t *sess, int type, int flags, uint32_t stream_id,
+                                const unsigned char *p, size_t len) {
+    // Mientras un bloque de cabeceras está incompleto solo se admite CONTINUATION.
+    if (sess->hblock_stream != 0 && (type != H2_CONTINUATION || stream_id != sess->hblock_stream)) {
+        return H2_PROTOCOL_ERROR;
+    }
+
+    switch (type) {
+    case H2_HEADERS: {
+        size_t pad = 0;
+        if (stream_id == 0 || (stream_id % 2) == 0) {
+            return H2_PROTOCOL_ERROR;
+        }
+        if (flags & H2_FLAG_PADDED) {
+            if (len < 1) {
+                return H2_PROTOCOL_ERROR;
+            }
+            pad = p[0];
+            p++;
+            len--;
+        }
+        if (flags & H2_FLAG_PRIORITY) {
+            if (len < 5) {
+                return H2_PROTOCOL_ERROR;
+            }
+            p += 5;
+            len -= 5;
+        }
+        if (pad > len) {
+            return H2_PROTOCOL_ERROR;
+        }
+        len -= pad;
+        sess->hblock_len = 0;
+        sess->hblock_stream = stream_id;
+        sess->hblock_end_stream = flags & H2_FLAG_END_STREAM;
+    }
+    // fallthrough: el fragmento se trata igual que uno de CONTINUATION.
+    case H2_CONTINUATION:
+        if (sess->hblock_stream == 0) {
+            return H2_PROTOCOL_ERROR;
+        }
+        if (sess->hblock_len + len > H2_MAX_HEADER_BLOCK) {
+            return H2_PROTOCOL_ERROR;
+        }
+        memcpy(sess->hblock + sess->hblock_len, p, len);
+        sess->hblock_len += len;
+        if (flags & H2_FLAG_END_HEADERS) {
+            return h2_finish_header_block(sess);
+        }
+        return 0;
+
+    case H2_DATA: {
+        h2_stream_t *s = h2_find_stream(sess, stream_id);
+        size_t frame_len = len;
+        if (flags & H2_FLAG_PADDED) {
+            if (len < 1 || p[0] >= len) {
+                return H2_PROTOCOL_ERROR;
+            }
+            len -= 1 + p[0];
+            p++;
+        }
+        // Los datos se consumen al instante: se devuelve el crédito completo.
+        if (frame_len > 0) {
+            h2_send_u32_frame(sess, H2_WINDOW_UPDATE, 0, frame_len);
+        }
+        if (s == NULL || s->dispatched) {
+            return 0;
+        }
+        if (frame_len > 0 && !(flags & H2_FLAG_END_STREAM)) {
+            h2_send_u32_frame(sess, H2_WINDOW_UPDATE, stream_id, frame_len);
+        }
+        if (s->body_len + len > H2_MAX_BODY) {
+            h2_send_u32_frame(sess, H2_RST_STREAM, stream_id, H2_REFUSED_STREAM);
+            h2_stream_destroy(sess, s);
+            return 0;
+        }
+        if (len > 0) {
+            char *bigger = realloc(s->body, s->body_len + len + 1);
+            assert(bigger != NULL);
+            s->body = bigger;
+            memcpy(s->body + s->body_len, p, len);
+            s->body_len += len;
+            s->body[s->body_len] = '\0';
+        }
+        if (flags & H2_FLAG_END_STREAM) {
+            h2_stream_dispatch(sess, s);
+        }
+        return 0;
+    }
+
+    case H2_SETTINGS:
+        if (stream_id != 0 || (len % 6) != 0) {
+            return H2_PROTOCOL_ERROR;
+        }
+        if (flags & H2_FLAG_ACK) {
+            return 0;
+        }
+        {
+            uint32_t err = h2_apply_settings(sess, p, len);
+            if (err != 0) {
+                return err;
+            }
+        }
+        h2_send_frame(sess, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+        return 0;
+
+    case H2_PING:
+        if (len != 8) {
+            return H2_FRAME_SIZE_ERROR;
+        }
+        if (!(flags & H2_FLAG_ACK)) {
+            h2_send_frame(sess, H2_PING, H2_FLAG_ACK, 0, p, len);
+        }
+        return 0;
+
+    case H2_WINDOW_UPDATE: {
+        if (len != 4) {
+            return H2_FRAME_SIZE_ERROR;
+        }
+        uint32_t inc = h2_get32(p) & 0x7fffffff;
+        if (stream_id == 0) {
+            sess->conn_send_window += inc;
+        } else {
+            h2_stream_t *s = h2_find_stream(sess, stream_id);
+            if (s != NULL) {
+                s->send_window += inc;
+            }
+        }
+        return 0;
+    }
+
+    case H2_RST_STREAM: {
+        h2_stream_t *s = h2_find_stream(sess, stream_id);
+        if (s == NULL) {
+            return 0;
+        }
+        s->cancelled = 1;
+        // Si un trabajador lo está procesando, se libera cuando publique
+        // su respuesta.
+        if (!s->dispatched || s->responded) {
+            h2_stream_destroy(sess, s);
+        }
+        return 0;
+    }
+
+    case H2_GOAWAY:
+        sess->goaway = 1;
+        return 0;
+
+    case H2_PUSH_PROMISE:
+        return H2_PROTOCOL_ERROR;
+
+    default:
+        // PRIORITY y los tipos desconocidos se ignoran.
+        return 0;
+    }
+}
+
+/**
+ * @brief Procesa todos los frames completos del búfer de lectura.
+ *
+ * @return 0 en caso de éxito, o un código de error de conexión.
+ */
+static uint32_t h2_process_input(h2_session_t *sess) {
+    size_t pos = 0;
+    uint32_t err = 0;
+
+    while (sess->rlen - pos >= H2_FRAME_HEADER_LEN) {
+        unsigned char *h = sess->rbuf + pos;
+        size_t len = ((size_t)h[0] << 16) | (h[1] << 8) | h[2];
+        if (len > H2_MAX_FRAME) {
+            err = H2_FRAME_SIZE_ERROR;
+            break;
+        }
+        if (sess->rlen - pos < H2_FRAME_HEADER_LEN + len) {
+            break;
+        }
+        err = h2_handle_frame(sess, h[3], h[4], h2_get32(h + 5) & 0x7fffffff, h + H2_FRAME_HEADER_LEN, len);
+        pos += H2_FRAME_HEADER_LEN + len;
+        if (err != 0) {
+            break;
+        }
+    }
+    memmove(sess->rbuf, sess->rbuf + pos, sess->rlen - pos);
+    sess->rlen -= pos;
+    return err;
+}
+
+/**
+ * @brief Envía tantos frames de respuesta como permitan las ventanas de flujo.
+ * * Recorre los streams con respuesta lista en turnos: en cada pasada cada
+ * stream envía como máximo un frame, de modo que una respuesta grande no
+ * retrasa a las demás de la misma conexión.
+ *
+ * @return 0 en caso de éxito, -1 si el cliente cerró la conexión.
+ */
+static int h2_flush_output(h2_session_t *sess) {
+    int progress = 1;
+
+    while (progress) {
+        progress = 0;
+        h2_stream_t *s = sess->streams;
+        while (s != NULL) {
+            h2_stream_t *next = s->next;
+            if (!s->responded) {
+                s = next;
+                continue;
+            }
+            if (s->cancelled) {
+                h2_stream_destroy(sess, s);
+                s = next;
+                continue;
+            }
+            if (!s->headers_sent) {
+                int flags = H2_FLAG_END_HEADERS | (s->resp_len == 0 ? H2_FLAG_END_STREAM : 0);
+                if (h2_send_frame(sess, H2_HEADERS, flags, s->id, s->resp_headers, s->resp_headers_len) < 0) {
+                    return -1;
+                }
+                s->headers_sent = 1;
+                progress = 1;
+            } else if (s->resp_sent < s->resp_len) {
+                int64_t n = s->resp_len - s->resp_sent;
+                if (n > sess->peer_max_frame) {
+                    n = sess->peer_max_frame;
+                }
+                if (n > sess->conn_send_window) {
+                    n = sess->conn_send_window;
+                }
+                if (n > s->send_window) {
+                    n = s->send_window;
+                }
+                if (n > 0) {
+                    int last = (s->resp_sent + n == s->resp_len);
+                    if (h2_send_frame(sess, H2_DATA, last ? H2_FLAG_END_STREAM : 0, s->id,
+                                      (unsigned char *)s->resp_body + s->resp_sent, n) < 0) {
+                        return -1;
+                    }
+                    s->resp_sent += n;
+                    s->send_window -= n;
+                    sess->conn_send_window -= n;
+                    progress = 1;
+                }
+            }
+            if (s->headers_sent && s->resp_sent >= s->resp_len) {
+                h2_stream_destroy(sess, s);
+            }
+            s = next;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Lee exactamente len bytes del socket (usado para el prefacio).
+ *
+ * @return 0 en caso de éxito, -1 si la conexión se cerró antes.
+ */
+static int h2_read_exact(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t rc = read(fd, buf, len);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rutina del hilo que atiende una conexión HTTP/2.
+ * * Lee y procesa los frames del cliente, encola cada petición completa como
+ * un stream independiente y envía las respuestas que publican los
+ * trabajadores. Al terminar espera a que ningún trabajador esté usando
+ * streams de la conexión antes de liberarla.
+ *
+ * @param arg La sesión (h2_session_t *).
+ * @return NULL.
+ */
+static void *h2_session_routine(void *arg) {
+    h2_session_t *sess = (h2_session_t *)arg;
+
+    // La petición que pidió el upgrade se encola desde este hilo y no desde
+    // el trabajador, que podría bloquearse si el búfer está lleno.
+    h2_stream_t *upgraded = h2_find_stream(sess, 1);
+    if (upgraded != NULL) {
+        h2_stream_dispatch(sess, upgraded);
+    }
+
+    while (1) {
+        if (__atomic_load_n(&draining_global, __ATOMIC_RELAXED) && !sess->goaway) {
+            h2_send_goaway(sess, H2_NO_ERROR);
+            sess->goaway = 1;
+        }
+        if (h2_flush_output(sess) < 0) {
+            break;
+        }
+        if (sess->goaway && sess->open_streams == 0) {
+            break;
+        }
+
+        struct pollfd pfds[2] = {
+            { .fd = sess->fd, .events = POLLIN },
+            { .fd = sess->wake_pipe[0], .events = POLLIN },
+        };
+        int timeout = (sess->open_streams == 0) ? H2_IDLE_TIMEOUT_MS : -1;
+        int rc = poll(pfds, 2, timeout);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (rc == 0) {
+            h2_send_goaway(sess, H2_NO_ERROR);
+            break;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(sess->wake_pipe[0], drain, sizeof(drain)) > 0)
+                ;
+            // Recoge las respuestas publicadas por los trabajadores; a partir
+            // de aquí solo este hilo las usa.
+            pthread_mutex_lock(&sess->mutex);
+            h2_stream_t *done = sess->done_head;
+            sess->done_head = NULL;
+            pthread_mutex_unlock(&sess->mutex);
+            for (; done != NULL; done = done->next_done) {
+                done->responded = 1;
+            }
+        }
+
+        if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (sess->rcap - sess->rlen < H2_MAX_FRAME) {
+                sess->rbuf = pool_resize(sess->rbuf, sess->rcap, sess->rcap * 2);
+                sess->rcap *= 2;
+            }
+            ssize_t n = read(sess->fd, sess->rbuf + sess->rlen, sess->rcap - sess->rlen);
+            if (n <= 0) {
+                break;
+            }
+            sess->rlen += n;
+            uint32_t err = h2_process_input(sess);
+            if (err != 0) {
+                fprintf(stderr, "[HTTP2 FD=%d] Error de protocolo %u, cerrando conexión\n", sess->fd, err);
+                h2_send_goaway(sess, err);
+                break;
+            }
+        }
+    }
+
+    // Los streams en manos de trabajadores siguen apuntando a la sesión.
+    pthread_mutex_lock(&sess->mutex);
+    while (sess->in_worker > 0) {
+        pthread_cond_wait(&sess->idle_cond, &sess->mutex);
+    }
+    pthread_mutex_unlock(&sess->mutex);
+
+    printf("[HTTP2 FD=%d] Conexión cerrada\n", sess->fd);
+    h2_session_unregister(sess);
+    while (sess->streams != NULL) {
+        h2_stream_destroy(sess, sess->streams);
+    }
+    hpack_table_free(&sess->decoder);
+    close_or_die(sess->wake_pipe[0]);
+    close_or_die(sess->wake_pipe[1]);
+    close_or_die(sess->fd);
+    pthread_mutex_destroy(&sess->mutex);
+    pthread_cond_destroy(&sess->idle_cond);
+    pool_put(sess->rbuf, sess->rcap);
+    pool_put(sess->hblock, H2_MAX_HEADER_BLOCK);
+    free(sess);
+    return NULL;
+}
+
+/**
+ * @brief Decodifica base64url sin relleno (valor de HTTP2-Settings).
+ *
+ * @return La cantidad de bytes decodificados, o -1 si la entrada no es válida.
+ */
+static int h2_base64url_decode(const char *in, unsigned char *out, size_t cap) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    unsigned int acc = 0;
+    int bits = 0;
+    size_t n = 0;
+
+    for (; *in && *in != '='; in++) {
+        const char *pos = strchr(alphabet, *in);
+        if (pos == NULL) {
+            return -1;
+        }
+        acc = (acc << 6) | (unsigned int)(pos - alphabet);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n >= cap) {
+                return -1;
+            }
+            out[n++] = (acc >> bits) & 0xff;
+        }
+    }
+    return (int)n;
+}
+
+/**
+ * @brief Convierte una conexión en una sesión HTTP/2 atendida por su propio hilo.
+ * * Se invoca desde request_handle() al detectar el prefacio (conocimiento
+ * previo) o tras responder 101 a un "Upgrade: h2c". En este último caso la
+ * petición original se convierte en el stream 1.
+ *
+ * @param fd El socket de la conexión; la sesión pasa a ser su dueña.
+ * @param preface_rest La parte del prefacio que aún falta leer del socket.
+ * @param upgrade_uri La URI de la petición HTTP/1.1 que pidió el upgrade, o NULL.
+ * @param upgrade_settings El valor de HTTP2-Settings de esa petición, o NULL.
+ * @return 0 si la sesión quedó en marcha, -1 en caso de error (el llamador
+ * conserva el socket).
+ */
+int http2_start(int fd, const char *preface_rest, const char *upgrade_uri, const char *upgrade_settings) {
+    char preface[H2_PREFACE_LEN];
+    size_t rest_len = strlen(preface_rest);
+
+    if (h2_read_exact(fd, preface, rest_len) < 0 || memcmp(preface, preface_rest, rest_len) != 0) {
+        fprintf(stderr, "[HTTP2 FD=%d] Prefacio inválido\n", fd);
+        return -1;
+    }
+
+    h2_session_t *sess = calloc(1, sizeof(h2_session_t));
+    assert(sess != NULL);
+    sess->fd = fd;
+    pthread_mutex_init(&sess->mutex, NULL);
+    pthread_cond_init(&sess->idle_cond, NULL);
+    pipe_or_die(sess->wake_pipe);
+    fcntl(sess->wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(sess->wake_pipe[1], F_SETFL, O_NONBLOCK);
+    hpack_table_init(&sess->decoder, 4096);
+    sess->conn_send_window = H2_DEFAULT_WINDOW;
+    sess->initial_window = H2_DEFAULT_WINDOW;
+    sess->peer_max_frame = 16384;
+    sess->rcap = 2 * H2_MAX_FRAME;
+    // Los búferes de la sesión salen de los pools: se reutilizan entre
+    // conexiones sin volver a pedirlos al sistema.
+    sess->rbuf = pool_get(sess->rcap);
+    sess->hblock = pool_get(H2_MAX_HEADER_BLOCK);
+
+    if (upgrade_settings != NULL) {
+        unsigned char settings[MAXBUF];
+        int n = h2_base64url_decode(upgrade_settings, settings, sizeof(settings));
+        if (n > 0 && n % 6 == 0) {
+            h2_apply_settings(sess, settings, n);
+        }
+    }
+
+    // Preferencias del servidor: límite de streams concurrentes.
+    unsigned char settings[6] = { 0, H2_SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, H2_MAX_STREAMS };
+    h2_send_frame(sess, H2_SETTINGS, 0, 0, settings, sizeof(settings));
+
+    printf("[HTTP2 FD=%d] Sesión HTTP/2 iniciada (%s)\n", fd, upgrade_uri ? "upgrade" : "conocimiento previo");
+
+    if (upgrade_uri != NULL) {
+        h2_stream_t *s = h2_stream_create(sess, 1);
+        snprintf(s->method, sizeof(s->method), "GET");
+        s->path = strdup(upgrade_uri);
+    }
+
+    pthread_t session_thread;
+    h2_session_register(sess);
+    if (pthread_create(&session_thread, NULL, h2_session_routine, sess) != 0) {
+        perror("No se pudo crear el hilo de la sesión HTTP/2");
+        h2_session_unregister(sess);
+        while (sess->streams != NULL) {
+            h2_stream_destroy(sess, sess->streams);
+        }
+        hpack_table_free(&sess->decoder);
+        close_or_die(sess->wake_pipe[0]);
+        close_or_die(sess->wake_pipe[1]);
+        pthread_mutex_destroy(&sess->mutex);
+        pthread_cond_destroy(&sess->idle_cond);
+        pool_put(sess->rbuf, sess->rcap);
+        pool_put(sess->hblock, H2_MAX_HEADER_BLOCK);
+        free(sess);
+        return -1;
+    }
+    pthread_detach(session_thread);
+    return 0;
+}
+
+/**
+ * @brief Publica la respuesta de un stream y avisa al hilo de la sesión.
+ */
+static void h2_stream_publish(h2_stream_t *s) {
+    h2_session_t *sess = s->session;
+    char c = 0;
+
+    pthread_mutex_lock(&sess->mutex);
+    s->next_done = sess->done_head;
+    sess->done_head = s;
+    if (write(sess->wake_pipe[1], &c, 1) < 0 && errno != EAGAIN) {
+        perror("write(wake_pipe)");
+    }
+    sess->in_worker--;
+    if (sess->in_worker == 0) {
+        pthread_cond_signal(&sess->idle_cond);
+    }
+    pthread_mutex_unlock(&sess->mutex);
+}
+
+/**
+ * @brief Codifica las cabeceras de una respuesta en el stream.
+ *
+ * @param s El stream.
+ * @param status El código de estado HTTP.
+ * @param content_type El tipo MIME del cuerpo.
+ * @param extra Cabeceras adicionales del CGI en formato "Nombre: valor\r\n", o NULL.
+ */
+static void h2_stream_set_headers(h2_stream_t *s, int status, const char *content_type, char *extra) {
+    unsigned char *out = pool_get(MAXBUF);
+    char value[32];
+    size_t n = 0;
+
+    assert(out != NULL);
+    snprintf(value, sizeof(value), "%d", status);
+    n += hpack_encode_header(out + n, MAXBUF - n, HPACK_STATIC_STATUS, NULL, value);
+    n += hpack_encode_header(out + n, MAXBUF - n, HPACK_STATIC_SERVER, NULL, "OSTEP WebServer");
+    // Un 304 no tiene cuerpo ni describe uno.
+    if (status != 304) {
+        n += hpack_encode_header(out + n, MAXBUF - n, HPACK_STATIC_CONTENT_TYPE, NULL, content_type);
+        snprintf(value, sizeof(value), "%lu", (unsigned long)s->resp_len);
+        n += hpack_encode_header(out + n, MAXBUF - n, HPACK_STATIC_CONTENT_LENGTH, NULL, value);
+    }
+
+    // Cabeceras propias del CGI; las de conexión no existen en HTTP/2.
+    for (char *line = extra ? strtok(extra, "\r\n") : NULL; line != NULL; line = strtok(NULL, "\r\n")) {
+        char *colon = strchr(line, ':');
+        if (colon == NULL) {
+            continue;
+        }
+        *colon = '\0';
+        char *v = colon + 1;
+        while (*v == ' ') {
+            v++;
+        }
+        for (char *c = line; *c; c++) {
+            *c = tolower((unsigned char)*c);
+        }
+        if (strcmp(line, "content-length") == 0 || strcmp(line, "content-type") == 0 ||
+            strcmp(line, "connection") == 0 || strcmp(line, "transfer-encoding") == 0 ||
+            strcmp(line, "keep-alive") == 0 || strcmp(line, "status") == 0) {
+            continue;
+        }
+        n += hpack_encode_header(out + n, MAXBUF - n, 0, line, v);
+    }
+
+    s->resp_headers = out;
+    s->resp_headers_len = n;
+}
+
+/**
+ * @brief Prepara una respuesta de error con el mismo cuerpo HTML que request_error().
+ */
+static void h2_stream_error(h2_stream_t *s, const char *cause, int status, const char *shortmsg, const char *longmsg) {
+    char *body = malloc(MAXBUF);
+    assert(body != NULL);
+
+    snprintf(body, MAXBUF, ""
+             "<!doctype html>\r\n"
+             "<head>\r\n"
+             "  <title>OSTEP WebServer Error</title>\r\n"
+             "</head>\r\n"
+             "<body>\r\n"
+             "  <h2>%d: %s</h2>\r\n"
+             "  <p>%s: %s</p>\r\n"
+             "</body>\r\n"
+             "</html>\r\n", status, shortmsg, longmsg, cause);
+    s->resp_body = body;
+    s->resp_len = strlen(body);
+    s->resp_mapped = 0;
+    h2_stream_set_headers(s, status, "text/html", NULL);
+}
+
+/**
+ * @brief Prepara la respuesta de un stream a partir de una salida con el
+ * formato de un CGI (cabeceras, línea vacía y cuerpo).
+ * * Las cabeceras se separan del cuerpo, que se mueve al inicio del búfer
+ * para no copiarlo. El búfer pasa a ser del stream.
+ *
+ * @param s El stream.
+ * @param status El código de estado HTTP.
+ * @param out La salida capturada, o NULL.
+ * @param out_len El tamaño de la salida.
+ * @return 0 en caso de éxito, -1 si no hay salida o le faltan las cabeceras
+ * (en ese caso el búfer ya se liberó).
+ */
+static int h2_stream_set_output(h2_stream_t *s, int status, char *out, size_t out_len) {
+    char *sep = out ? strstr(out, "\r\n\r\n") : NULL;
+    if (sep == NULL) {
+        free(out);
+        return -1;
+    }
+    *sep = '\0';
+    char *headers = strdup(out);
+    char content_type[MAXBUF] = "text/html";
+    char *ct = strcasestr(headers, "Content-Type:");
+    if (ct != NULL) {
+        sscanf(ct + strlen("Content-Type:"), " %[^\r\n]", content_type);
+    }
+    s->resp_len = out_len - (sep + 4 - out);
+    memmove(out, sep + 4, s->resp_len);
+    s->resp_body = out;
+    s->resp_mapped = 0;
+    h2_stream_set_headers(s, status, content_type, headers);
+    free(headers);
+    return 0;
+}
+
+/**
+ * @brief Procesa la petición de un stream en un hilo trabajador.
+ * * Equivale a request_handle() para HTTP/2: valida la petición, sirve el
+ * archivo estático (mapeado en memoria) o ejecuta el plugin o el CGI
+ * capturando su salida, y publica la respuesta para que la envíe el hilo
+ * de la sesión.
+ *
+ * @param s El stream extraído del búfer compartido.
+ */
+void http2_stream_process(h2_stream_t *s) {
+    char uri[MAXBUF], filename[MAXBUF], cgiargs[MAXBUF], filetype[MAXBUF];
+    struct stat sbuf;
+    int is_static, route;
+
+    printf("[HTTP2 FD=%d] Stream %u: Method=%s URI=%s\n", s->session->fd, s->id, s->method, s->path ? s->path : "");
+    snprintf(uri, MAXBUF, "%s", s->path ? s->path : "");
+
+    if (uri[0] != '/') {
+        h2_stream_error(s, uri, 400, "Bad Request", "missing or invalid :path");
+    } else if (strstr(uri, "..")) {
+        h2_stream_error(s, uri, 403, "Forbidden", "Path traversal attempt detected in URI.");
+    } else if (strcasecmp(s->method, "GET") != 0 && strcasecmp(s->method, "POST") != 0) {
+        h2_stream_error(s, s->method, 501, "Not Implemented", "server does not implement this method");
+    } else if ((route = plugin_match(uri)) >= 0) {
+        int status;
+        size_t out_len;
+        char *out = plugin_capture(route, s->method, uri, s->body, s->body_len, &status, &out_len);
+        if (h2_stream_set_output(s, status, out, out_len) < 0) {
+            h2_stream_error(s, uri, 500, "Internal Server Error", "plugin handler failed");
+        }
+    } else if ((is_static = request_parse_uri(uri, filename, cgiargs)) && pack_loaded()) {
+        // Contenido estático desde el paquete: el cuerpo se envía desde la
+        // región mapeada sin copiarlo ni liberarlo.
+        const pack_entry_t *entry = pack_lookup(filename);
+        if (entry == NULL) {
+            h2_stream_error(s, filename, 404, "Not found", "server could not find this file");
+        } else if (strcasecmp(s->method, "POST") == 0) {
+            h2_stream_error(s, filename, 405, "Method Not Allowed", "POST method is not supported for static content");
+        } else if (pack_not_modified(entry, s->if_none_match ? s->if_none_match : "")) {
+            char etag[MAXBUF];
+            snprintf(etag, sizeof(etag), "ETag: %s\r\n", entry->etag);
+            s->resp_body = NULL;
+            s->resp_len = 0;
+            s->resp_mapped = 0;
+            h2_stream_set_headers(s, 304, pack_at(entry->mime_off), etag);
+        } else {
+            char extra[MAXBUF];
+            const char *data;
+            int gzip = pack_variant(entry, s->accept_gzip, &data, &s->resp_len);
+            snprintf(extra, sizeof(extra), "ETag: %s\r\n%s%s", entry->etag,
+                     gzip ? "Content-Encoding: gzip\r\n" : "",
+                     entry->gzip_size > 0 ? "Vary: Accept-Encoding\r\n" : "");
+            s->resp_body = (char *)data;
+            s->resp_mapped = 0;
+            s->resp_borrowed = 1;
+            h2_stream_set_headers(s, 200, pack_at(entry->mime_off), extra);
+        }
+    } else if (stat(filename, &sbuf) < 0) {
+        h2_stream_error(s, filename, 404, "Not found", "server could not find this file");
+    } else if (is_static) {
+        if (strcasecmp(s->method, "POST") == 0) {
+            h2_stream_error(s, filename, 405, "Method Not Allowed", "POST method is not supported for static content");
+        } else if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) {
+            h2_stream_error(s, filename, 403, "Forbidden", "server could not read this file");
+        } else {
+            mime_get_filetype(filename, filetype);
+            s->resp_len = sbuf.st_size;
+            s->resp_body = NULL;
+            if (s->resp_len > 0) {
+                int srcfd = open_or_die(filename, O_RDONLY, 0);
+                s->resp_body = mmap_or_die(0, s->resp_len, PROT_READ, MAP_PRIVATE, srcfd, 0);
+                s->resp_mapped = 1;
+                close_or_die(srcfd);
+            }
+            h2_stream_set_headers(s, 200, filetype, NULL);
+        }
+    } else if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
+        h2_stream_error(s, filename, 403, "Forbidden", "server could not run this CGI program");
+    } else {
+        size_t out_len;
+        char *out;
+        if (cgi_cache_enabled() && strcasecmp(s->method, "GET") == 0) {
+            out = cgi_cache_get(filename, cgiargs, &out_len);
+        } else {
+            out = request_cgi_capture(filename, cgiargs, s->body, (int)s->body_len, &out_len);
+        }
+        if (h2_stream_set_output(s, 200, out, out_len) < 0) {
+            h2_stream_error(s, filename, 500, "Internal Server Error", "CGI program produced no headers");
+        }
+    }
+
+    h2_stream_publish(s);
+}
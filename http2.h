@@ -0,0 +1,18 @@
+#ifndef __HTTP2_H__
+#define __HTTP2_H__
+
+#include <sys/types.h>
+
+// Prefacio de conexión que envía todo cliente HTTP/2 (RFC 7540, 3.5).
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN (24)
+
+typedef struct h2_stream h2_stream_t;
+
+void http2_init(void (*enqueue)(h2_stream_t *stream, off_t size_for_sff, int is_dynamic));
+int http2_start(int fd, const char *preface_rest, const char *upgrade_uri, const char *upgrade_settings);
+void http2_stream_process(h2_stream_t *stream);
+void http2_drain(void);
+int http2_active_sessions(void);
+
+#endif // __HTTP2_H__
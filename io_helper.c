@@ -20,7 +20,7 @@ ssize_t readline(int fd, void *buf, size_t maxlen) {
     int n;
     for (n = 0; n < maxlen - 1; n++) {
 	int rc;
-        if ((rc = read_or_die(fd, &c, 1)) == 1) {
+        if ((rc = read(fd, &c, 1)) == 1) {
             *bufp++ = c;
             if (c == '\n')
                 break;
@@ -69,6 +69,59 @@ int open_client_fd(char *hostname, int port) {
     return client_fd;
 }
 
+/**
+ * @brief Abre una conexión con una dirección ya resuelta (TCP o Unix).
+ * * A diferencia de open_client_fd(), no resuelve nombres, así que se puede
+ * llamar desde varios hilos a la vez. Con un tiempo límite, connect() y
+ * cada lectura o escritura posterior fallan con EAGAIN al agotarse.
+ *
+ * @param addr La dirección del servidor (sockaddr_in o sockaddr_un).
+ * @param addr_len El tamaño de la dirección.
+ * @param timeout_ms El tiempo límite en milisegundos, o 0 para no tenerlo.
+ *
+ * @return Un descriptor de archivo conectado, o -1 en caso de error.
+ */
+int open_client_fd_addr(const sockaddr_t *addr, socklen_t addr_len, int timeout_ms) {
+    int client_fd;
+
+    if ((client_fd = socket(addr->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+
+    if (timeout_ms > 0) {
+        struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    if (connect(client_fd, addr, addr_len) < 0) {
+        close(client_fd);
+        return -1;
+    }
+    return client_fd;
+}
+
+/**
+ * @brief Envía un búfer completo por un socket.
+ * * Repite send() hasta escribir todos los bytes. Usa MSG_NOSIGNAL, de modo
+ * que si el otro extremo cerró la conexión se devuelve un error en lugar
+ * de recibir SIGPIPE.
+ *
+ * @return 0 en caso de éxito, o -1 en caso de error.
+ */
+int send_all(int fd, const void *buf, size_t count) {
+    const char *p = buf;
+    while (count > 0) {
+        ssize_t n = send(fd, p, count, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        count -= n;
+    }
+    return 0;
+}
+
 /**
  * @brief Crea y prepara un socket de escucha para un servidor.
  * * Esta función realiza los pasos necesarios para que un servidor acepte 
@@ -0,0 +1,355 @@
+#include "io_helper.h"
+#include "mempool.h"
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024) // Capacidad de cada bloque de la arena.
+#define ARENA_LARGE (ARENA_BLOCK_SIZE / 2) // Desde este tamaño la reserva lleva bloque propio.
+#define ARENA_ALIGN (16) // Alineación de cada reserva de la arena.
+
+#define POOL_NUM_CLASSES (5)
+#define POOL_CACHE_MAX (16) // Búferes por clase en la caché de cada hilo.
+#define POOL_GLOBAL_MAX (1024) // Búferes por clase en la lista global; el resto se libera.
+
+struct arena_block {
+    struct arena_block *next;
+    size_t cap; // Bytes de datos del bloque.
+    size_t used;
+};
+
+// Los datos empiezan tras la cabecera, redondeada a la alineación.
+#define ARENA_HEADER ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static const size_t pool_class_size[POOL_NUM_CLASSES] = { 4096, 8192, 16384, 32768, 65536 };
+
+// Lista de búferes libres; el enlace se guarda dentro del propio búfer.
+typedef struct pool_free {
+    struct pool_free *next;
+} pool_free_t;
+
+typedef struct {
+    pool_free_t *head;
+    int count;
+} pool_list_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pool_list_t list;
+} pool_global_t;
+
+static __thread arena_t thread_arena; // Arena del hilo actual.
+static __thread pool_list_t thread_cache[POOL_NUM_CLASSES]; // Caché de búferes del hilo actual.
+static pool_global_t global_pools[POOL_NUM_CLASSES] = {
+    [0 ... POOL_NUM_CLASSES - 1] = { PTHREAD_MUTEX_INITIALIZER, { NULL, 0 } },
+};
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key; // Vacía la caché del hilo cuando este termina.
+static __thread int cache_registered; // 1 si el hilo ya tiene el destructor.
+
+// Estadísticas, con operaciones atómicas.
+static uint64_t arena_allocs; // Reservas en arenas.
+static uint64_t arena_resets; // Peticiones terminadas.
+static uint64_t arena_blocks; // Bloques de arena pedidos a malloc().
+static uint64_t arena_large; // Reservas grandes con bloque propio.
+static uint64_t arena_peak; // Mayor uso de una arena en una petición.
+static uint64_t pool_hits_thread[POOL_NUM_CLASSES]; // Servidos desde la caché del hilo.
+static uint64_t pool_hits_global[POOL_NUM_CLASSES]; // Servidos desde la lista global.
+static uint64_t pool_misses[POOL_NUM_CLASSES]; // Búferes nuevos.
+static int64_t pool_in_use[POOL_NUM_CLASSES]; // Búferes entregados y no devueltos.
+static uint64_t pool_large; // Búferes mayores que la última clase.
+
+// --- Arena ---
+
+/**
+ * @brief Devuelve la arena del hilo actual.
+ * * Los trabajadores la reinician al terminar cada petición.
+ */
+arena_t *arena_thread(void) {
+    return &thread_arena;
+}
+
+/**
+ * @brief Pide un bloque nuevo a malloc().
+ *
+ * @return El bloque, o NULL si no hay memoria.
+ */
+static arena_block_t *arena_block_new(size_t cap) {
+    arena_block_t *b = (arena_block_t *)malloc(ARENA_HEADER + cap);
+    if (b == NULL) {
+        return NULL;
+    }
+    b->next = NULL;
+    b->cap = cap;
+    b->used = 0;
+    return b;
+}
+
+/**
+ * @brief Reserva memoria que dura hasta el siguiente arena_reset().
+ * * Avanza un puntero dentro del bloque actual. Los bloques que se llenan
+ * se encadenan y se conservan al reiniciar, así que tras las primeras
+ * peticiones ya no se llama a malloc(). Las reservas grandes (cuerpos de
+ * POST) llevan un bloque propio para no inflar la arena.
+ *
+ * @param a La arena.
+ * @param size El tamaño en bytes.
+ * @return Memoria alineada a ARENA_ALIGN, o NULL si no hay memoria (el
+ * tamaño puede venir del cliente, como el Content-Length de un POST).
+ */
+void *arena_alloc(arena_t *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    __atomic_fetch_add(&arena_allocs, 1, __ATOMIC_RELAXED);
+
+    if (size >= ARENA_LARGE) {
+        arena_block_t *b = arena_block_new(size);
+        if (b == NULL) {
+            return NULL;
+        }
+        b->next = a->large;
+        a->large = b;
+        a->used += size;
+        __atomic_fetch_add(&arena_large, 1, __ATOMIC_RELAXED);
+        return (char *)b + ARENA_HEADER;
+    }
+
+    if (a->first == NULL) {
+        a->first = a->current = arena_block_new(ARENA_BLOCK_SIZE);
+        if (a->first == NULL) {
+            return NULL;
+        }
+        __atomic_fetch_add(&arena_blocks, 1, __ATOMIC_RELAXED);
+    }
+    while (a->current->cap - a->current->used < size) {
+        if (a->current->next == NULL) {
+            a->current->next = arena_block_new(ARENA_BLOCK_SIZE);
+            if (a->current->next == NULL) {
+                return NULL;
+            }
+            __atomic_fetch_add(&arena_blocks, 1, __ATOMIC_RELAXED);
+        }
+        a->current = a->current->next;
+        a->current->used = 0;
+    }
+    void *p = (char *)a->current + ARENA_HEADER + a->current->used;
+    a->current->used += size;
+    a->used += size;
+    return p;
+}
+
+/**
+ * @brief Libera de una vez todo lo reservado en la arena.
+ * * Solo vuelve al primer bloque; los bloques encadenados se reutilizan en
+ * la siguiente petición. Las reservas grandes, si las hubo, se liberan.
+ */
+void arena_reset(arena_t *a) {
+    uint64_t peak = __atomic_load_n(&arena_peak, __ATOMIC_RELAXED);
+    while (a->used > peak &&
+           !__atomic_compare_exchange_n(&arena_peak, &peak, a->used, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    __atomic_fetch_add(&arena_resets, 1, __ATOMIC_RELAXED);
+
+    while (a->large != NULL) {
+        arena_block_t *next = a->large->next;
+        free(a->large);
+        a->large = next;
+    }
+    if (a->first != NULL) {
+        a->first->used = 0;
+        a->current = a->first;
+    }
+    a->used = 0;
+}
+
+// --- Pools de búferes ---
+
+/**
+ * @brief Devuelve la clase más pequeña en la que cabe un tamaño, o -1.
+ */
+static int pool_class(size_t size) {
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        if (size <= pool_class_size[c]) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Pasa a la lista global los búferes de una caché de hilo, hasta que
+ * en ella queden keep.
+ */
+static void pool_spill(int c, int keep) {
+    pool_list_t *cache = &thread_cache[c];
+    pool_global_t *g = &global_pools[c];
+
+    pthread_mutex_lock(&g->mutex);
+    while (cache->count > keep) {
+        pool_free_t *f = cache->head;
+        cache->head = f->next;
+        cache->count--;
+        if (g->list.count < POOL_GLOBAL_MAX) {
+            f->next = g->list.head;
+            g->list.head = f;
+            g->list.count++;
+        } else {
+            free(f);
+        }
+    }
+    pthread_mutex_unlock(&g->mutex);
+}
+
+/**
+ * @brief Destructor de cache_key: los hilos de las sesiones HTTP/2 terminan
+ * con la conexión y sus búferes deben volver a la lista global.
+ */
+static void pool_thread_exit(void *unused) {
+    (void)unused;
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        pool_spill(c, 0);
+    }
+}
+
+static void pool_key_create(void) {
+    pthread_key_create(&cache_key, pool_thread_exit);
+}
+
+/**
+ * @brief Obtiene un búfer de E/S de al menos size bytes.
+ * * Se sirve de la caché del hilo, después de la lista global (trayendo
+ * varios a la vez) y, si ambas están vacías, de un búfer nuevo. Los
+ * tamaños mayores que la última clase se piden directamente al sistema.
+ *
+ * @param size El tamaño en bytes.
+ * @return Un búfer alineado a POOL_ALIGN; nunca NULL.
+ */
+void *pool_get(size_t size) {
+    int c = pool_class(size);
+    void *buf;
+
+    if (c < 0) {
+        buf = aligned_alloc(POOL_ALIGN, (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1));
+        assert(buf != NULL);
+        __atomic_fetch_add(&pool_large, 1, __ATOMIC_RELAXED);
+        return buf;
+    }
+    __atomic_fetch_add(&pool_in_use[c], 1, __ATOMIC_RELAXED);
+
+    pool_list_t *cache = &thread_cache[c];
+    if (cache->head == NULL) {
+        pool_global_t *g = &global_pools[c];
+        pthread_mutex_lock(&g->mutex);
+        while (g->list.head != NULL && cache->count < POOL_CACHE_MAX / 2) {
+            pool_free_t *f = g->list.head;
+            g->list.head = f->next;
+            g->list.count--;
+            f->next = cache->head;
+            cache->head = f;
+            cache->count++;
+        }
+        pthread_mutex_unlock(&g->mutex);
+        if (cache->head == NULL) {
+            __atomic_fetch_add(&pool_misses[c], 1, __ATOMIC_RELAXED);
+            buf = aligned_alloc(POOL_ALIGN, pool_class_size[c]);
+            assert(buf != NULL);
+            return buf;
+        }
+        __atomic_fetch_add(&pool_hits_global[c], 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&pool_hits_thread[c], 1, __ATOMIC_RELAXED);
+    }
+    pool_free_t *f = cache->head;
+    cache->head = f->next;
+    cache->count--;
+    return f;
+}
+
+/**
+ * @brief Devuelve un búfer obtenido con pool_get().
+ * * Puede devolverlo un hilo distinto del que lo obtuvo. Cuando la caché
+ * del hilo se llena, la mitad pasa a la lista global, y al terminar el hilo
+ * pasa toda.
+ *
+ * @param buf El búfer, o NULL.
+ * @param size El tamaño con el que se pidió.
+ */
+void pool_put(void *buf, size_t size) {
+    int c = pool_class(size);
+
+    if (buf == NULL) {
+        return;
+    }
+    if (c < 0) {
+        free(buf);
+        return;
+    }
+    __atomic_fetch_sub(&pool_in_use[c], 1, __ATOMIC_RELAXED);
+
+    if (!cache_registered) {
+        pthread_once(&cache_key_once, pool_key_create);
+        pthread_setspecific(cache_key, &cache_registered);
+        cache_registered = 1;
+    }
+    pool_list_t *cache = &thread_cache[c];
+    pool_free_t *f = (pool_free_t *)buf;
+    f->next = cache->head;
+    cache->head = f;
+    cache->count++;
+    if (cache->count > POOL_CACHE_MAX) {
+        pool_spill(c, POOL_CACHE_MAX / 2);
+    }
+}
+
+/**
+ * @brief Cambia el tamaño de un búfer de los pools conservando su contenido.
+ *
+ * @return El búfer, que es el mismo si el tamaño nuevo cabe en su clase.
+ */
+void *pool_resize(void *buf, size_t old_size, size_t new_size) {
+    int c = pool_class(old_size);
+    if (c >= 0 && c == pool_class(new_size)) {
+        return buf;
+    }
+    void *bigger = pool_get(new_size);
+    memcpy(bigger, buf, old_size < new_size ? old_size : new_size);
+    pool_put(buf, old_size);
+    return bigger;
+}
+
+/**
+ * @brief Muestra el uso de memoria del proceso, de las arenas y de los pools.
+ * * La invoca el maestro al recibir SIGUSR1 y al apagarse.
+ */
+void mempool_dump(void) {
+    long rss_pages = 0;
+    struct rusage ru;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%*s %ld", &rss_pages) != 1) {
+            rss_pages = 0;
+        }
+        fclose(f);
+    }
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("[MEMORIA] rss=%ld KiB pico_rss=%ld KiB\n", rss_pages * (sysconf(_SC_PAGESIZE) / 1024), ru.ru_maxrss);
+    printf("[MEMORIA] arena: reservas=%llu peticiones=%llu bloques=%llu (%llu KiB) grandes=%llu "
+           "pico_por_peticion=%llu B\n",
+           (unsigned long long)__atomic_load_n(&arena_allocs, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&arena_resets, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&arena_blocks, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&arena_blocks, __ATOMIC_RELAXED) * ARENA_BLOCK_SIZE / 1024,
+           (unsigned long long)__atomic_load_n(&arena_large, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&arena_peak, __ATOMIC_RELAXED));
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        pthread_mutex_lock(&global_pools[c].mutex);
+        int global_free = global_pools[c].list.count;
+        pthread_mutex_unlock(&global_pools[c].mutex);
+        printf("[MEMORIA] pool %5zu B: cache_hilo=%llu global=%llu nuevos=%llu en_uso=%lld libres_globales=%d\n",
+               pool_class_size[c], (unsigned long long)__atomic_load_n(&pool_hits_thread[c], __ATOMIC_RELAXED),
+               (unsigned long long)__atomic_load_n(&pool_hits_global[c], __ATOMIC_RELAXED),
+               (unsigned long long)__atomic_load_n(&pool_misses[c], __ATOMIC_RELAXED),
+               (long long)__atomic_load_n(&pool_in_use[c], __ATOMIC_RELAXED), global_free);
+    }
+    printf("[MEMORIA] pool grandes: %llu\n", (unsigned long long)__atomic_load_n(&pool_large, __ATOMIC_RELAXED));
+    fflush(stdout);
+}
@@ -0,0 +1,34 @@
+#ifndef __MEMPOOL_H__
+#define __MEMPOOL_H__
+
+#include <stddef.h>
+
+// --- Memoria por petición y búferes de E/S reutilizables ---
+// Cada hilo tiene una arena para lo que solo vive durante una petición:
+// se reserva avanzando un puntero y se libera entera, en O(1), cuando la
+// petición termina. Los búferes de E/S de las conexiones salen de pools por
+// tamaño, alineados a la línea de caché, con una caché por hilo y una lista
+// global compartida detrás.
+
+#define POOL_ALIGN (64) // Alineación de los búferes de los pools.
+
+typedef struct arena_block arena_block_t;
+
+typedef struct {
+    arena_block_t *first; // Primer bloque; nunca se libera.
+    arena_block_t *current; // Bloque del que se reserva ahora.
+    arena_block_t *large; // Reservas grandes, con bloque propio; se liberan al reiniciar.
+    size_t used; // Bytes reservados desde el último reinicio.
+} arena_t;
+
+arena_t *arena_thread(void);
+void *arena_alloc(arena_t *a, size_t size);
+void arena_reset(arena_t *a);
+
+void *pool_get(size_t size);
+void pool_put(void *buf, size_t size);
+void *pool_resize(void *buf, size_t old_size, size_t new_size);
+
+void mempool_dump(void);
+
+#endif // __MEMPOOL_H__
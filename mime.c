@@ -0,0 +1,25 @@
+#include "mime.h"
+#include <string.h>
+
+/**
+ * @brief Determina el tipo MIME de un archivo basado en su extensión.
+ *
+ * @param filename El nombre del archivo.
+ * @param filetype Búfer de salida donde se almacenará el string del tipo MIME.
+ */
+void mime_get_filetype(const char *filename, char *filetype) {
+    if (strstr(filename, ".html")) 
+	strcpy(filetype, "text/html");
+    else if (strstr(filename, ".gif")) 
+	strcpy(filetype, "image/gif");
+    else if (strstr(filename, ".jpg")) 
+	strcpy(filetype, "image/jpeg");
+    else if (strstr(filename, ".pdf"))
+    strcpy(filetype, "application/pdf");
+    else if (strstr(filename, ".css"))
+    strcpy(filetype, "text/css");   
+    else if (strstr(filename, ".js"))
+    strcpy(filetype, "application/javascript");
+    else 
+	strcpy(filetype, "text/plain");
+}
@@ -0,0 +1,10 @@
+#ifndef __MIME_H__
+#define __MIME_H__
+
+// --- Tipos MIME ---
+// Lo usan el servidor al responder y wpack al generar el paquete, que solo
+// enlaza este módulo.
+
+void mime_get_filetype(const char *filename, char *filetype);
+
+#endif // __MIME_H__
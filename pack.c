@@ -0,0 +1,148 @@
+#include "io_helper.h"
+#include "pack.h"
+
+// Paquete de contenido mapeado en memoria. Se abre una sola vez al arrancar
+// y nunca se modifica, así que los trabajadores lo leen sin sincronización.
+static const char *pack_base; // Inicio de la región mapeada (NULL = sin paquete).
+static size_t pack_size; // Tamaño de la región.
+static const pack_entry_t *pack_index; // Índice ordenado por ruta.
+static uint32_t pack_count; // Entradas del índice.
+
+/**
+ * @brief Comprueba que un rango [off, off + len) cae dentro del paquete.
+ */
+static int pack_range_ok(uint64_t off, uint64_t len) {
+    return off <= pack_size && len <= pack_size - off;
+}
+
+/**
+ * @brief Comprueba que una cadena del paquete está terminada dentro de él.
+ */
+static int pack_string_ok(uint64_t off) {
+    return off < pack_size && memchr(pack_base + off, '\0', pack_size - off) != NULL;
+}
+
+/**
+ * @brief Mapea en memoria un paquete generado por wpack y valida su índice.
+ * * Después de esta llamada el contenido estático se sirve desde el paquete
+ * sin ningún stat() ni open(). Como el archivo queda mapeado, sustituirlo con
+ * rename() no afecta al servidor en marcha: el despliegue es atómico.
+ *
+ * @param path La ruta del paquete.
+ * @return 0 en caso de éxito, -1 si el archivo no existe o no es válido.
+ */
+int pack_open(const char *path) {
+    struct stat sbuf;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open(pack)");
+        return -1;
+    }
+    if (fstat(fd, &sbuf) < 0 || (size_t)sbuf.st_size < sizeof(pack_header_t)) {
+        fprintf(stderr, "El paquete %s está vacío o no se puede leer\n", path);
+        close_or_die(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close_or_die(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap(pack)");
+        return -1;
+    }
+    madvise(base, sbuf.st_size, MADV_WILLNEED);
+
+    pack_base = base;
+    pack_size = sbuf.st_size;
+    const pack_header_t *hdr = (const pack_header_t *)pack_base;
+    int ok = memcmp(hdr->magic, PACK_MAGIC, sizeof(hdr->magic)) == 0 && hdr->size == pack_size &&
+             hdr->index_off % sizeof(uint64_t) == 0 &&
+             pack_range_ok(hdr->index_off, (uint64_t)hdr->count * sizeof(pack_entry_t));
+
+    pack_index = (const pack_entry_t *)(pack_base + hdr->index_off);
+    pack_count = hdr->count;
+    for (uint32_t i = 0; ok && i < pack_count; i++) {
+        const pack_entry_t *e = &pack_index[i];
+        ok = pack_string_ok(e->path_off) && pack_string_ok(e->mime_off) &&
+             pack_range_ok(e->data_off, e->data_size) && pack_range_ok(e->gzip_off, e->gzip_size) &&
+             memchr(e->etag, '\0', PACK_ETAG_LEN) != NULL &&
+             (i == 0 || strcmp(pack_at(pack_index[i - 1].path_off), pack_at(e->path_off)) < 0);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "El paquete %s no es válido\n", path);
+        munmap_or_die(base, sbuf.st_size);
+        pack_base = NULL;
+        pack_index = NULL;
+        pack_count = 0;
+        return -1;
+    }
+    printf("Paquete %s cargado: %u archivos, %zu bytes\n", path, pack_count, pack_size);
+    return 0;
+}
+
+/**
+ * @brief Indica si hay un paquete de contenido cargado.
+ */
+int pack_loaded(void) {
+    return pack_base != NULL;
+}
+
+/**
+ * @brief Devuelve un puntero a un desplazamiento del paquete.
+ */
+const char *pack_at(uint64_t off) {
+    return pack_base + off;
+}
+
+/**
+ * @brief Busca un archivo en el índice del paquete.
+ *
+ * @param filename La ruta tal como la genera request_parse_uri() ("./index.html").
+ * @return La entrada del archivo, o NULL si no está en el paquete.
+ */
+const pack_entry_t *pack_lookup(const char *filename) {
+    uint32_t lo = 0, hi = pack_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(filename, pack_at(pack_index[mid].path_off));
+        if (cmp == 0) {
+            return &pack_index[mid];
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Indica si el cliente ya tiene la versión actual de un archivo.
+ *
+ * @param e La entrada del archivo.
+ * @param if_none_match El valor de If-None-Match de la petición, o "".
+ * @return 1 si el ETag coincide (se responde 304), 0 si no.
+ */
+int pack_not_modified(const pack_entry_t *e, const char *if_none_match) {
+    return if_none_match[0] != '\0' && strstr(if_none_match, e->etag) != NULL;
+}
+
+/**
+ * @brief Elige la variante de un archivo que se envía al cliente.
+ *
+ * @param e La entrada del archivo.
+ * @param accept_gzip 1 si el cliente acepta Content-Encoding gzip.
+ * @param data Salida: el inicio de la variante en la región mapeada.
+ * @param size Salida: el tamaño de la variante.
+ * @return 1 si se eligió la variante comprimida (el cliente la acepta y el
+ * paquete la tiene), 0 si el contenido original.
+ */
+int pack_variant(const pack_entry_t *e, int accept_gzip, const char **data, size_t *size) {
+    int gzip = accept_gzip && e->gzip_size > 0;
+    *data = pack_at(gzip ? e->gzip_off : e->data_off);
+    *size = gzip ? e->gzip_size : e->data_size;
+    return gzip;
+}
@@ -0,0 +1,43 @@
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Formato del paquete de contenido generado por wpack. Todos los
+// desplazamientos son relativos al inicio del archivo y los enteros se
+// guardan en el orden de bytes de la máquina que generó el paquete.
+//
+//   [pack_header_t][datos de los archivos y variantes gzip][cadenas][índice]
+//
+// El índice es un arreglo de pack_entry_t ordenado por ruta con strcmp(),
+// de modo que una búsqueda binaria resuelve cada petición.
+#define PACK_MAGIC "WPACK001"
+#define PACK_ETAG_LEN (24)
+
+typedef struct {
+    char magic[8]; // PACK_MAGIC, sin '\0'.
+    uint32_t count; // Número de entradas del índice.
+    uint32_t reserved;
+    uint64_t index_off; // Desplazamiento del índice.
+    uint64_t size; // Tamaño total del paquete (para validarlo al abrirlo).
+} pack_header_t;
+
+typedef struct {
+    uint64_t path_off; // Ruta como la genera request_parse_uri() ("./index.html").
+    uint64_t mime_off; // Tipo MIME precalculado.
+    uint64_t data_off; // Contenido del archivo.
+    uint64_t data_size;
+    uint64_t gzip_off; // Variante comprimida con gzip (0 si no tiene).
+    uint64_t gzip_size;
+    char etag[PACK_ETAG_LEN]; // ETag entre comillas, terminado en '\0'.
+} pack_entry_t;
+
+int pack_open(const char *path);
+int pack_loaded(void);
+const pack_entry_t *pack_lookup(const char *filename);
+const char *pack_at(uint64_t off);
+int pack_not_modified(const pack_entry_t *e, const char *if_none_match);
+int pack_variant(const pack_entry_t *e, int accept_gzip, const char **data, size_t *size);
+
+#endif // __PACK_H__
@@ -0,0 +1,327 @@
+#include "io_helper.h"
+#include "plugin.h"
+#include "request.h"
+#include "trace.h"
+#include <dlfcn.h>
+#include <stdarg.h>
+
+#define MAXBUF (8192)
+#define PLUGIN_MAX (16)
+#define PLUGIN_MAX_ROUTES (64)
+
+struct plugin_response {
+    int status;
+    char reason[64];
+    char *headers; // Cabeceras añadidas por el manejador, ya con "\r\n".
+    size_t headers_len, headers_cap;
+    char *body;
+    size_t body_len, body_cap;
+    int has_content_type;
+};
+
+// Una ruta registrada y el plugin al que pertenece.
+typedef struct {
+    const plugin_route_t *route;
+    int plugin;
+} plugin_loaded_route_t;
+
+static const plugin_t *plugins[PLUGIN_MAX];
+static int num_plugins;
+static plugin_loaded_route_t routes[PLUGIN_MAX_ROUTES];
+static int num_routes;
+
+static __thread void *thread_data[PLUGIN_MAX]; // Datos de thread_init por plugin.
+static __thread int thread_ready; // 1 si este hilo ya ejecutó los thread_init.
+
+/**
+ * @brief Carga un plugin y registra sus rutas.
+ * * Debe llamarse antes de crear los hilos trabajadores.
+ *
+ * @param path La ruta de la biblioteca compartida, relativa al directorio
+ * de arranque o absoluta.
+ * @return 0 en caso de éxito, -1 si no se pudo cargar.
+ */
+int plugin_load(const char *path) {
+    char full_path[MAXBUF];
+
+    if (num_plugins == PLUGIN_MAX) {
+        fprintf(stderr, "Demasiados plugins\n");
+        return -1;
+    }
+    // Sin '/' dlopen() buscaría en las rutas de bibliotecas del sistema.
+    snprintf(full_path, sizeof(full_path), "%s%s", strchr(path, '/') ? "" : "./", path);
+    void *lib = dlopen(full_path, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        fprintf(stderr, "No se pudo cargar el plugin %s: %s\n", path, dlerror());
+        return -1;
+    }
+    const plugin_t *p = (const plugin_t *)dlsym(lib, PLUGIN_SYMBOL);
+    if (p == NULL || p->api_version != PLUGIN_API_VERSION || p->routes == NULL) {
+        fprintf(stderr, "%s no es un plugin compatible (API %d)\n", path, PLUGIN_API_VERSION);
+        dlclose(lib);
+        return -1;
+    }
+
+    // Se validan todas las rutas antes de registrar ninguna, para no dejar
+    // en la tabla rutas de un plugin que no se llegó a cargar, y antes de
+    // su init() para no dejar efectos de un plugin rechazado.
+    int count = 0;
+    for (const plugin_route_t *r = p->routes; r->prefix != NULL; r++, count++) {
+        if (num_routes + count == PLUGIN_MAX_ROUTES || r->handle == NULL) {
+            fprintf(stderr, "Ruta no válida en el plugin %s: %s\n", p->name, r->prefix);
+            dlclose(lib);
+            return -1;
+        }
+    }
+    if (p->init != NULL && p->init() < 0) {
+        fprintf(stderr, "El plugin %s falló al iniciarse\n", p->name);
+        dlclose(lib);
+        return -1;
+    }
+
+    for (const plugin_route_t *r = p->routes; r->prefix != NULL; r++) {
+        routes[num_routes].route = r;
+        routes[num_routes].plugin = num_plugins;
+        num_routes++;
+        printf("Plugin %s: %s\n", p->name, r->prefix);
+    }
+    plugins[num_plugins++] = p;
+    return 0;
+}
+
+/**
+ * @brief Ejecuta los thread_init de todos los plugins en el hilo actual.
+ * * Los trabajadores la llaman al arrancar; plugin_handle() la llama si un
+ * hilo atiende un plugin sin haberlo hecho.
+ */
+void plugin_thread_init(void) {
+    if (thread_ready) {
+        return;
+    }
+    for (int i = 0; i < num_plugins; i++) {
+        thread_data[i] = plugins[i]->thread_init ? plugins[i]->thread_init() : NULL;
+    }
+    thread_ready = 1;
+}
+
+/**
+ * @brief Busca la ruta de plugin con el prefijo más largo que coincide.
+ *
+ * @return El índice de la ruta, o -1 si ningún plugin atiende la URI.
+ */
+int plugin_match(const char *uri) {
+    int best = -1;
+    size_t best_len = 0;
+    for (int i = 0; i < num_routes; i++) {
+        size_t len = strlen(routes[i].route->prefix);
+        if (len > best_len && strncmp(uri, routes[i].route->prefix, len) == 0) {
+            best = i;
+            best_len = len;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Añade bytes a un búfer que crece según se necesita.
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria.
+ */
+static int plugin_append(char **buf, size_t *len, size_t *cap, const void *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t new_cap = *cap ? *cap : 1024;
+        while (new_cap < *len + n) {
+            new_cap *= 2;
+        }
+        char *p = realloc(*buf, new_cap);
+        if (p == NULL) {
+            return -1;
+        }
+        *buf = p;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    return 0;
+}
+
+/**
+ * @brief Fija el código de estado de la respuesta (por defecto, 200 OK).
+ */
+void plugin_set_status(plugin_response_t *resp, int status, const char *reason) {
+    resp->status = status;
+    snprintf(resp->reason, sizeof(resp->reason), "%s", reason);
+}
+
+/**
+ * @brief Añade una cabecera a la respuesta. Content-Length la pone el
+ * servidor; si no se indica Content-Type se envía text/html.
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria.
+ */
+int plugin_add_header(plugin_response_t *resp, const char *name, const char *value) {
+    char line[MAXBUF];
+    int n = snprintf(line, sizeof(line), "%s: %s\r\n", name, value);
+    if (n < 0 || n >= (int)sizeof(line)) {
+        return -1;
+    }
+    if (strcasecmp(name, "Content-Type") == 0) {
+        resp->has_content_type = 1;
+    }
+    return plugin_append(&resp->headers, &resp->headers_len, &resp->headers_cap, line, n);
+}
+
+/**
+ * @brief Añade datos al cuerpo de la respuesta.
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria.
+ */
+int plugin_write(plugin_response_t *resp, const void *data, size_t len) {
+    return plugin_append(&resp->body, &resp->body_len, &resp->body_cap, data, len);
+}
+
+/**
+ * @brief Añade texto con formato al cuerpo de la respuesta.
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria.
+ */
+int plugin_printf(plugin_response_t *resp, const char *fmt, ...) {
+    char small[MAXBUF];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return -1;
+    }
+    if (n < (int)sizeof(small)) {
+        return plugin_write(resp, small, n);
+    }
+
+    char *big = malloc(n + 1);
+    if (big == NULL) {
+        return -1;
+    }
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    int rc = plugin_write(resp, big, n);
+    free(big);
+    return rc;
+}
+
+/**
+ * @brief Ejecuta el manejador de una ruta en el hilo actual.
+ *
+ * @param route El índice devuelto por plugin_match().
+ * @param resp La respuesta a construir; el llamador libera headers y body.
+ * @return Lo que devuelve el manejador.
+ */
+static int plugin_run(int route, char *method, char *uri, char *body, size_t body_length, plugin_response_t *resp) {
+    plugin_loaded_route_t *r = &routes[route];
+    plugin_request_t req;
+    char path[MAXBUF];
+
+    plugin_thread_init();
+
+    snprintf(path, sizeof(path), "%s", uri);
+    char *query = strchr(path, '?');
+    if (query != NULL) {
+        *query++ = '\0';
+    }
+    req.method = method;
+    req.uri = uri;
+    req.path = path;
+    req.query = query ? query : "";
+    req.body = body;
+    req.body_length = body_length;
+    req.thread_data = thread_data[r->plugin];
+
+    memset(resp, 0, sizeof(*resp));
+    plugin_set_status(resp, 200, "OK");
+    return r->route->handle(&req, resp);
+}
+
+/**
+ * @brief Atiende una petición con el manejador de un plugin.
+ * * El manejador se ejecuta en el hilo trabajador actual y construye la
+ * respuesta en memoria; al volver se envía con su Content-Length.
+ *
+ * @param fd El descriptor de archivo de la conexión.
+ * @param route El índice devuelto por plugin_match().
+ * @param method El método de la petición.
+ * @param uri La URI de la petición.
+ * @param body El cuerpo de la petición, o NULL.
+ * @param body_length El tamaño del cuerpo.
+ * @return 0; la conexión debe cerrarse.
+ */
+int plugin_handle(int fd, int route, char *method, char *uri, char *body, size_t body_length) {
+    plugin_response_t resp;
+
+    if (plugin_run(route, method, uri, body, body_length, &resp) < 0) {
+        request_error(fd, uri, "500", "Internal Server Error", "plugin handler failed");
+    } else {
+        char buf[MAXBUF];
+        snprintf(buf, sizeof(buf), ""
+                 "HTTP/1.0 %d %s\r\n"
+                 "Server: OSTEP WebServer\r\n"
+                 "%s"
+                 "Content-Length: %zu\r\n",
+                 resp.status, resp.reason, resp.has_content_type ? "" : "Content-Type: text/html\r\n", resp.body_len);
+        write_or_die(fd, buf, strlen(buf));
+        trace_mark(TRACE_FIRST_BYTE);
+        if (resp.headers_len > 0) {
+            write_or_die(fd, resp.headers, resp.headers_len);
+        }
+        write_or_die(fd, "\r\n", 2);
+        if (resp.body_len > 0) {
+            write_or_die(fd, resp.body, resp.body_len);
+        }
+        trace_set_bytes(resp.body_len);
+        trace_mark(TRACE_LAST_BYTE);
+    }
+    free(resp.headers);
+    free(resp.body);
+    return 0;
+}
+
+/**
+ * @brief Atiende una petición con un plugin y devuelve la respuesta en
+ * memoria, para los streams HTTP/2.
+ * * El resultado tiene el mismo formato que la salida capturada de un CGI:
+ * las cabeceras (siempre con Content-Type), una línea vacía y el cuerpo.
+ *
+ * @param route El índice devuelto por plugin_match().
+ * @param method El método de la petición.
+ * @param uri La URI de la petición.
+ * @param body El cuerpo de la petición, o NULL.
+ * @param body_length El tamaño del cuerpo.
+ * @param status Salida: el código de estado que fijó el manejador.
+ * @param out_len Salida: el tamaño del resultado.
+ * @return El resultado (a liberar con free()), o NULL si el manejador falló
+ * o no hay memoria.
+ */
+char *plugin_capture(int route, char *method, char *uri, char *body, size_t body_length, int *status,
+                     size_t *out_len) {
+    plugin_response_t resp;
+    char *out = NULL;
+
+    if (plugin_run(route, method, uri, body, body_length, &resp) >= 0) {
+        const char *ct = resp.has_content_type ? "" : "Content-Type: text/html\r\n";
+        size_t ct_len = strlen(ct);
+        *out_len = ct_len + resp.headers_len + 2 + resp.body_len;
+        out = malloc(*out_len + 1);
+        if (out != NULL) {
+            memcpy(out, ct, ct_len);
+            memcpy(out + ct_len, resp.headers, resp.headers_len);
+            memcpy(out + ct_len + resp.headers_len, "\r\n", 2);
+            memcpy(out + ct_len + resp.headers_len + 2, resp.body, resp.body_len);
+            out[*out_len] = '\0';
+            *status = resp.status;
+        }
+    }
+    free(resp.headers);
+    free(resp.body);
+    return out;
+}
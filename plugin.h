@@ -0,0 +1,54 @@
+#ifndef __PLUGIN_H__
+#define __PLUGIN_H__
+
+#include <stddef.h>
+
+// --- API para los plugins ---
+// Un plugin es una biblioteca compartida que exporta una variable
+// "wserver_plugin" de tipo plugin_t. El servidor la carga al arrancar con
+// -l y ejecuta sus manejadores en los hilos trabajadores, sin fork ni exec.
+#define PLUGIN_API_VERSION (1)
+#define PLUGIN_SYMBOL "wserver_plugin"
+
+typedef struct {
+    const char *method;
+    const char *uri; // URI completa.
+    const char *path; // URI sin la query string.
+    const char *query; // Lo que sigue a '?', o "".
+    const char *body; // Cuerpo de la petición, o NULL.
+    size_t body_length;
+    void *thread_data; // Lo que devolvió thread_init en este hilo, o NULL.
+} plugin_request_t;
+
+// Respuesta en construcción; se envía al cliente cuando el manejador vuelve.
+typedef struct plugin_response plugin_response_t;
+
+void plugin_set_status(plugin_response_t *resp, int status, const char *reason);
+int plugin_add_header(plugin_response_t *resp, const char *name, const char *value);
+int plugin_write(plugin_response_t *resp, const void *data, size_t len);
+int plugin_printf(plugin_response_t *resp, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+typedef struct {
+    const char *prefix; // Prefijo de URI que atiende el manejador.
+    // Devuelve 0 si la respuesta está lista, o un valor negativo para
+    // responder 500 Internal Server Error.
+    int (*handle)(const plugin_request_t *req, plugin_response_t *resp);
+} plugin_route_t;
+
+typedef struct {
+    int api_version; // PLUGIN_API_VERSION.
+    const char *name;
+    const plugin_route_t *routes; // Terminadas en { NULL, NULL }.
+    int (*init)(void); // Opcional: al cargar; un valor negativo aborta el arranque.
+    void *(*thread_init)(void); // Opcional: una vez en cada hilo trabajador.
+} plugin_t;
+
+// --- Lado del servidor ---
+int plugin_load(const char *path);
+void plugin_thread_init(void);
+int plugin_match(const char *uri);
+int plugin_handle(int fd, int route, char *method, char *uri, char *body, size_t body_length);
+char *plugin_capture(int route, char *method, char *uri, char *body, size_t body_length, int *status,
+                     size_t *out_len);
+
+#endif // __PLUGIN_H__
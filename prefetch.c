@@ -0,0 +1,283 @@
+#include "io_helper.h"
+#include "prefetch.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define PREFETCH_SLOTS (256) // Peticiones pendientes de precarga; si se llena, se descartan.
+
+enum {
+    PREFETCH_EMPTY, // Hueco libre.
+    PREFETCH_QUEUED, // Esperando al hilo de precarga.
+    PREFETCH_WORKING, // El hilo comprueba la residencia o espera presupuesto.
+    PREFETCH_ADVISED, // Precargada; sus bytes cuentan hasta que un trabajador la saque del búfer.
+    PREFETCH_CANCELLED, // Un trabajador la sacó del búfer antes de precargarla.
+};
+
+typedef struct {
+    uint64_t id; // Identificador que guarda la entrada del búfer.
+    int state;
+    char path[PATH_MAX]; // Archivo a precargar, o "" para un rango del paquete.
+    const char *addr; // Rango del paquete mapeado.
+    size_t len;
+    size_t bytes; // Bytes no residentes que se pidieron al núcleo.
+} prefetch_slot_t;
+
+// Estado compartido, protegido por prefetch_mutex. Las peticiones se
+// numeran en orden de llegada; la n-ésima ocupa el hueco n % PREFETCH_SLOTS.
+static pthread_mutex_t prefetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER; // Trabajo nuevo o presupuesto liberado.
+static prefetch_slot_t slots[PREFETCH_SLOTS];
+static uint64_t queue_head; // Siguiente petición que atiende el hilo.
+static uint64_t queue_tail; // Siguiente petición que se encola.
+static size_t budget; // Bytes precargados como máximo para peticiones en cola (0 = desactivada).
+static size_t in_flight; // Bytes precargados de peticiones que siguen en cola.
+static long page_size;
+static unsigned char *residency; // Vector de mincore() para un presupuesto completo.
+
+// Estadísticas.
+static uint64_t stat_submitted; // Peticiones recibidas del maestro.
+static uint64_t stat_dropped; // Descartadas por tener la cola llena.
+static uint64_t stat_resident; // Ya estaban en la caché de páginas.
+static uint64_t stat_advised; // Precargadas.
+static uint64_t stat_advised_bytes;
+static uint64_t stat_cancelled; // Atendidas antes de precargarlas.
+
+/**
+ * @brief Cuenta los bytes de un rango mapeado que no están en memoria.
+ *
+ * @param start El inicio del rango, alineado a página.
+ * @param len La longitud del rango (como máximo el presupuesto).
+ * @return Los bytes no residentes, o 0 si mincore() falla.
+ */
+static size_t prefetch_missing_bytes(void *start, size_t len) {
+    size_t pages = (len + page_size - 1) / page_size;
+    size_t missing = 0;
+
+    if (len == 0 || mincore(start, len, residency) < 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < pages; i++) {
+        if (!(residency[i] & 1)) {
+            missing += page_size;
+        }
+    }
+    return missing;
+}
+
+/**
+ * @brief Hilo de precarga: atiende las peticiones en orden de llegada.
+ * * Para cada una mide cuánto del archivo (o del rango del paquete) falta en
+ * la caché de páginas y, si falta algo, espera a que quepa en el presupuesto
+ * y pide al núcleo una lectura anticipada sin esperar a que termine. Si un
+ * trabajador saca la petición del búfer mientras tanto, ya no se precarga.
+ */
+static void *prefetch_routine(void *arg) {
+    (void)arg;
+    char path[PATH_MAX];
+
+    pthread_mutex_lock(&prefetch_mutex);
+    while (1) {
+        while (queue_head == queue_tail) {
+            pthread_cond_wait(&prefetch_cond, &prefetch_mutex);
+        }
+        prefetch_slot_t *s = &slots[queue_head % PREFETCH_SLOTS];
+        queue_head++;
+        if (s->state == PREFETCH_CANCELLED) {
+            stat_cancelled++;
+            s->state = PREFETCH_EMPTY;
+            continue;
+        }
+        s->state = PREFETCH_WORKING;
+        strcpy(path, s->path);
+        const char *addr = s->addr;
+        size_t len = s->len;
+        pthread_mutex_unlock(&prefetch_mutex);
+
+        // Un archivo se mapea solo para consultar su residencia; del paquete
+        // se consulta directamente su mapeo, desde el inicio de la página.
+        int fd = -1;
+        char *start = NULL;
+        if (path[0] != '\0') {
+            struct stat sbuf;
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd >= 0 && fstat(fd, &sbuf) == 0 && S_ISREG(sbuf.st_mode) && sbuf.st_size > 0) {
+                len = (size_t)sbuf.st_size < budget ? (size_t)sbuf.st_size : budget;
+                start = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+                if (start == MAP_FAILED) {
+                    start = NULL;
+                }
+            }
+        } else {
+            start = (char *)((uintptr_t)addr & ~(uintptr_t)(page_size - 1));
+            len += addr - start;
+            if (len > budget) {
+                len = budget;
+            }
+        }
+        size_t missing = start ? prefetch_missing_bytes(start, len) : 0;
+
+        pthread_mutex_lock(&prefetch_mutex);
+        while (missing > 0 && s->state == PREFETCH_WORKING && in_flight + missing > budget) {
+            pthread_cond_wait(&prefetch_cond, &prefetch_mutex);
+        }
+        int advise = 0;
+        if (s->state == PREFETCH_CANCELLED) {
+            stat_cancelled++;
+            s->state = PREFETCH_EMPTY;
+        } else if (missing == 0) {
+            stat_resident += start != NULL;
+            s->state = PREFETCH_EMPTY;
+        } else {
+            s->state = PREFETCH_ADVISED;
+            s->bytes = missing;
+            in_flight += missing;
+            stat_advised++;
+            stat_advised_bytes += missing;
+            advise = 1;
+        }
+        pthread_mutex_unlock(&prefetch_mutex);
+
+        // Ambas llamadas solo inician la lectura; no esperan al disco.
+        if (advise && fd >= 0) {
+            posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+        } else if (advise) {
+            madvise(start, len, MADV_WILLNEED);
+        }
+        if (fd >= 0) {
+            if (start != NULL) {
+                munmap_or_die(start, len);
+            }
+            close_or_die(fd);
+        }
+        pthread_mutex_lock(&prefetch_mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Activa la precarga y arranca su hilo.
+ *
+ * @param budget_bytes Los bytes que pueden estar precargados a la vez para
+ * peticiones en cola, o 0 para no precargar.
+ */
+void prefetch_init(size_t budget_bytes) {
+    pthread_t thread;
+
+    if (budget_bytes == 0) {
+        return;
+    }
+    page_size = sysconf(_SC_PAGESIZE);
+    budget = budget_bytes;
+    residency = malloc(budget / page_size + 2);
+    assert(residency != NULL);
+    if (pthread_create(&thread, NULL, prefetch_routine, NULL) != 0) {
+        perror("No se pudo crear el hilo de precarga");
+        budget = 0;
+        return;
+    }
+    pthread_detach(thread);
+}
+
+/**
+ * @brief Indica si la precarga está activada (-A).
+ */
+int prefetch_enabled(void) {
+    return budget > 0;
+}
+
+/**
+ * @brief Encola una petición de precarga sin bloquear al maestro.
+ *
+ * @return El identificador de la petición, o 0 si se descartó.
+ */
+static uint64_t prefetch_submit(const char *path, const void *addr, size_t len) {
+    uint64_t id = 0;
+
+    pthread_mutex_lock(&prefetch_mutex);
+    stat_submitted++;
+    prefetch_slot_t *s = &slots[queue_tail % PREFETCH_SLOTS];
+    // El hueco puede seguir ocupado por una precarga cuya petición aún no
+    // ha salido del búfer.
+    if (queue_tail - queue_head >= PREFETCH_SLOTS || s->state != PREFETCH_EMPTY ||
+        (path != NULL && strlen(path) >= sizeof(s->path))) {
+        stat_dropped++;
+    } else {
+        id = ++queue_tail;
+        s->id = id;
+        s->state = PREFETCH_QUEUED;
+        if (path != NULL) {
+            strcpy(s->path, path);
+        } else {
+            s->path[0] = '\0';
+            s->addr = addr;
+            s->len = len;
+        }
+        s->bytes = 0;
+        pthread_cond_broadcast(&prefetch_cond);
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+    return id;
+}
+
+/**
+ * @brief Pide precargar un archivo.
+ *
+ * @param path La ruta, relativa al directorio raíz del servidor.
+ * @return El identificador que se pasa a prefetch_release() cuando un
+ * trabajador saca la petición del búfer, o 0 si no se precargará.
+ */
+uint64_t prefetch_file(const char *path) {
+    return prefetch_submit(path, NULL, 0);
+}
+
+/**
+ * @brief Pide precargar un rango del paquete de contenido mapeado.
+ *
+ * @param addr El inicio del rango.
+ * @param len La longitud del rango.
+ * @return Como prefetch_file().
+ */
+uint64_t prefetch_range(const void *addr, size_t len) {
+    return prefetch_submit(NULL, addr, len);
+}
+
+/**
+ * @brief Indica que un trabajador sacó la petición del búfer.
+ * * Sus bytes dejan de contar en el presupuesto y, si aún no se había
+ * precargado, ya no se hace.
+ *
+ * @param id El identificador devuelto al encolarla, o 0.
+ */
+void prefetch_release(uint64_t id) {
+    if (id == 0) {
+        return;
+    }
+    pthread_mutex_lock(&prefetch_mutex);
+    prefetch_slot_t *s = &slots[(id - 1) % PREFETCH_SLOTS];
+    if (s->id == id) {
+        if (s->state == PREFETCH_QUEUED || s->state == PREFETCH_WORKING) {
+            s->state = PREFETCH_CANCELLED;
+            pthread_cond_broadcast(&prefetch_cond);
+        } else if (s->state == PREFETCH_ADVISED) {
+            in_flight -= s->bytes;
+            s->state = PREFETCH_EMPTY;
+            pthread_cond_broadcast(&prefetch_cond);
+        }
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+/**
+ * @brief Muestra los contadores de la precarga (con SIGUSR1).
+ */
+void prefetch_dump(void) {
+    pthread_mutex_lock(&prefetch_mutex);
+    printf("[PRECARGA] presupuesto=%zu KiB en_curso=%zu KiB pedidas=%llu residentes=%llu precargadas=%llu "
+           "(%llu KiB) canceladas=%llu descartadas=%llu\n",
+           budget / 1024, in_flight / 1024, (unsigned long long)stat_submitted, (unsigned long long)stat_resident,
+           (unsigned long long)stat_advised, (unsigned long long)(stat_advised_bytes / 1024),
+           (unsigned long long)stat_cancelled, (unsigned long long)stat_dropped);
+    pthread_mutex_unlock(&prefetch_mutex);
+    fflush(stdout);
+}
@@ -0,0 +1,22 @@
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- Precarga de la caché de páginas ---
+// El maestro conoce el archivo de una petición estática antes de que un
+// trabajador la saque del búfer. Un hilo aparte pide al núcleo que lo lea
+// mientras la petición espera (posix_fadvise(WILLNEED), o madvise() sobre el
+// paquete mapeado), de modo que la lectura del disco se solapa con la espera
+// en cola. Los archivos ya residentes (según mincore()) se omiten, y los
+// bytes precargados para peticiones aún en cola no superan el presupuesto.
+
+void prefetch_init(size_t budget_bytes);
+int prefetch_enabled(void);
+uint64_t prefetch_file(const char *path);
+uint64_t prefetch_range(const void *addr, size_t len);
+void prefetch_release(uint64_t id);
+void prefetch_dump(void);
+
+#endif // __PREFETCH_H__
@@ -0,0 +1,546 @@
+#define _GNU_SOURCE
+#include "io_helper.h"
+#include "proxy.h"
+#include "request.h"
+#include "trace.h"
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/un.h>
+
+#define MAXBUF (8192)
+#define PROXY_MAX_ROUTES (16)
+#define PROXY_MAX_UPSTREAMS (16) // Servidores de origen por ruta.
+#define PROXY_MAX_IDLE (32) // Conexiones keep-alive libres por servidor de origen.
+#define PROXY_HEADERS_MAX (16384) // Tamaño máximo de un bloque de cabeceras.
+#define PROXY_COPY_BUF (16384)
+
+// Un servidor de origen y su pool de conexiones persistentes.
+typedef struct {
+    char name[256]; // "host:puerto" o "unix:/ruta", para los logs.
+    struct sockaddr_storage addr; // Dirección resuelta al arrancar.
+    socklen_t addr_len;
+    int idle_fds[PROXY_MAX_IDLE]; // Pila de conexiones libres.
+    int idle_count;
+    int active; // Peticiones en curso (para least-connections).
+} proxy_upstream_t;
+
+struct proxy_route {
+    char prefix[256];
+    proxy_upstream_t upstreams[PROXY_MAX_UPSTREAMS];
+    int num_upstreams;
+    unsigned int rr_next; // Siguiente servidor en el round-robin.
+    pthread_mutex_t mutex; // Protege el estado de los servidores de la ruta.
+};
+
+static proxy_route_t routes[PROXY_MAX_ROUTES];
+static int num_routes;
+static int least_conn_global; // 1: least-connections, 0: round-robin.
+static int timeout_ms_global = 5000; // Tiempo límite de conexión, lectura y escritura.
+
+/**
+ * @brief Resuelve la dirección de un servidor de origen.
+ * * Acepta "host:puerto" o "unix:/ruta/al/socket". La resolución ocurre una
+ * sola vez al arrancar, ya que gethostbyname() no es segura entre hilos.
+ *
+ * @return 0 en caso de éxito, -1 si la dirección no es válida.
+ */
+static int proxy_resolve(proxy_upstream_t *up, const char *spec) {
+    snprintf(up->name, sizeof(up->name), "%s", spec);
+    memset(&up->addr, 0, sizeof(up->addr));
+
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un *sun_addr = (struct sockaddr_un *)&up->addr;
+        if (strlen(spec + 5) == 0 || strlen(spec + 5) >= sizeof(sun_addr->sun_path)) {
+            return -1;
+        }
+        sun_addr->sun_family = AF_UNIX;
+        strcpy(sun_addr->sun_path, spec + 5);
+        up->addr_len = sizeof(struct sockaddr_un);
+        return 0;
+    }
+
+    char host[256];
+    int port;
+    const char *colon = strrchr(spec, ':');
+    if (colon == NULL || colon == spec || (size_t)(colon - spec) >= sizeof(host) || (port = atoi(colon + 1)) <= 0) {
+        return -1;
+    }
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+    struct hostent *hp = gethostbyname(host);
+    if (hp == NULL || hp->h_addrtype != AF_INET) {
+        return -1;
+    }
+    struct sockaddr_in *sin = (struct sockaddr_in *)&up->addr;
+    sin->sin_family = AF_INET;
+    memcpy(&sin->sin_addr, hp->h_addr, hp->h_length);
+    sin->sin_port = htons(port);
+    up->addr_len = sizeof(struct sockaddr_in);
+    return 0;
+}
+
+/**
+ * @brief Añade una ruta de proxy inverso.
+ * * El formato es "prefijo=origen[,origen...]", por ejemplo
+ * "/api/=127.0.0.1:9000,unix:/tmp/app.sock". Las peticiones cuya URI empieza
+ * por el prefijo se reenvían a uno de los servidores de origen.
+ *
+ * @param spec La especificación de la ruta.
+ * @return 0 en caso de éxito, -1 si no es válida.
+ */
+int proxy_add_route(const char *spec) {
+    const char *eq = strchr(spec, '=');
+    if (eq == NULL || eq == spec || spec[0] != '/' || num_routes == PROXY_MAX_ROUTES ||
+        (size_t)(eq - spec) >= sizeof(routes[0].prefix)) {
+        fprintf(stderr, "Ruta de proxy no válida: %s\n", spec);
+        return -1;
+    }
+
+    proxy_route_t *route = &routes[num_routes];
+    memcpy(route->prefix, spec, eq - spec);
+    route->prefix[eq - spec] = '\0';
+    route->num_upstreams = 0;
+
+    char list[MAXBUF];
+    snprintf(list, sizeof(list), "%s", eq + 1);
+    char *save = NULL;
+    for (char *up = strtok_r(list, ",", &save); up != NULL; up = strtok_r(NULL, ",", &save)) {
+        if (route->num_upstreams == PROXY_MAX_UPSTREAMS ||
+            proxy_resolve(&route->upstreams[route->num_upstreams], up) < 0) {
+            fprintf(stderr, "Servidor de origen no válido: %s\n", up);
+            return -1;
+        }
+        route->num_upstreams++;
+    }
+    if (route->num_upstreams == 0) {
+        fprintf(stderr, "La ruta de proxy %s no tiene servidores de origen\n", route->prefix);
+        return -1;
+    }
+    pthread_mutex_init(&route->mutex, NULL);
+    num_routes++;
+    printf("Proxy: %s -> %s (%d servidores)\n", route->prefix, eq + 1, route->num_upstreams);
+    return 0;
+}
+
+/**
+ * @brief Configura el reparto y el tiempo límite de todas las rutas.
+ *
+ * @param least_conn 1 para least-connections, 0 para round-robin.
+ * @param timeout_ms Tiempo límite de conexión, lectura y escritura con los
+ * servidores de origen, en milisegundos.
+ */
+void proxy_configure(int least_conn, int timeout_ms) {
+    least_conn_global = least_conn;
+    timeout_ms_global = timeout_ms;
+}
+
+/**
+ * @brief Busca la ruta de proxy con el prefijo más largo que coincide.
+ *
+ * @return La ruta, o NULL si la URI no va a un servidor de origen.
+ */
+const proxy_route_t *proxy_match(const char *uri) {
+    const proxy_route_t *best = NULL;
+    size_t best_len = 0;
+    for (int i = 0; i < num_routes; i++) {
+        size_t len = strlen(routes[i].prefix);
+        if (len > best_len && strncmp(uri, routes[i].prefix, len) == 0) {
+            best = &routes[i];
+            best_len = len;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Elige un servidor de origen y le asigna la petición.
+ * * Debe llamarse con el mutex de la ruta adquirido.
+ */
+static proxy_upstream_t *proxy_pick_locked(proxy_route_t *route) {
+    int chosen = route->rr_next++ % route->num_upstreams;
+    if (least_conn_global) {
+        // Empezando por el turno del round-robin para repartir los empates.
+        for (int i = 0; i < route->num_upstreams; i++) {
+            int idx = (chosen + i) % route->num_upstreams;
+            if (route->upstreams[idx].active < route->upstreams[chosen].active) {
+                chosen = idx;
+            }
+        }
+    }
+    route->upstreams[chosen].active++;
+    return &route->upstreams[chosen];
+}
+
+/**
+ * @brief Obtiene una conexión con el servidor de origen.
+ * * Reutiliza una conexión libre del pool si la hay. Una conexión libre que
+ * tiene algo para leer es una que el servidor de origen cerró (o que quedó
+ * en un estado inesperado), así que se descarta.
+ *
+ * @param reused Salida: 1 si la conexión viene del pool.
+ * @param fresh 1 para no usar el pool.
+ * @return El descriptor de la conexión, o -1 si no se pudo conectar.
+ */
+static int proxy_checkout(proxy_route_t *route, proxy_upstream_t *up, int *reused, int fresh) {
+    int fd = -1;
+
+    pthread_mutex_lock(&route->mutex);
+    while (!fresh && fd < 0 && up->idle_count > 0) {
+        fd = up->idle_fds[--up->idle_count];
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 0) != 0) {
+            close_or_die(fd);
+            fd = -1;
+        }
+    }
+    pthread_mutex_unlock(&route->mutex);
+
+    *reused = fd >= 0;
+    if (fd >= 0) {
+        return fd;
+    }
+    fd = open_client_fd_addr((sockaddr_t *)&up->addr, up->addr_len, timeout_ms_global);
+    if (fd >= 0 && up->addr.ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+/**
+ * @brief Devuelve una conexión al pool, o la cierra si no se puede reutilizar.
+ *
+ * @param fd La conexión, o -1 si ya se cerró.
+ * @param reusable 1 si la respuesta terminó limpiamente y el servidor de
+ * origen aceptó mantener la conexión abierta.
+ */
+static void proxy_release(proxy_route_t *route, proxy_upstream_t *up, int fd, int reusable) {
+    pthread_mutex_lock(&route->mutex);
+    up->active--;
+    if (fd >= 0 && reusable && up->idle_count < PROXY_MAX_IDLE) {
+        up->idle_fds[up->idle_count++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&route->mutex);
+    if (fd >= 0) {
+        close_or_die(fd);
+    }
+}
+
+/**
+ * @brief Copia exactamente len bytes de un socket a otro, por bloques.
+ *
+ * @param bytes Contador de bytes copiados, o NULL.
+ * @return 0 en caso de éxito, -1 si falló la lectura o llegó EOF antes de
+ * tiempo, -2 si falló la escritura.
+ */
+static int proxy_copy(int src, int dst, long long len, uint64_t *bytes) {
+    char buf[PROXY_COPY_BUF];
+    while (len > 0) {
+        ssize_t n = read(src, buf, len < (long long)sizeof(buf) ? (size_t)len : sizeof(buf));
+        if (n <= 0) {
+            return -1;
+        }
+        if (send_all(dst, buf, n) < 0) {
+            return -2;
+        }
+        len -= n;
+        if (bytes != NULL) {
+            *bytes += n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reenvía un cuerpo con Transfer-Encoding: chunked tal como llega.
+ * * Se interpretan los tamaños de los trozos solo para saber dónde termina
+ * el cuerpo, de modo que la conexión pueda reutilizarse después.
+ *
+ * @return Igual que proxy_copy().
+ */
+static int proxy_copy_chunked(int src, int dst, uint64_t *bytes) {
+    char line[MAXBUF];
+    while (1) {
+        if (readline(src, line, sizeof(line)) <= 0) {
+            return -1;
+        }
+        if (send_all(dst, line, strlen(line)) < 0) {
+            return -2;
+        }
+        long long size = strtoll(line, NULL, 16);
+        if (size < 0) {
+            return -1;
+        }
+        if (size == 0) {
+            break;
+        }
+        // Los datos del trozo y su CRLF final.
+        int rc = proxy_copy(src, dst, size + 2, bytes);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    // Cabeceras finales opcionales, hasta la línea vacía.
+    do {
+        if (readline(src, line, sizeof(line)) <= 0) {
+            return -1;
+        }
+        if (send_all(dst, line, strlen(line)) < 0) {
+            return -2;
+        }
+    } while (strcmp(line, "\r\n") != 0 && strcmp(line, "\n") != 0);
+    return 0;
+}
+
+/**
+ * @brief Lee la línea de estado de la respuesta final del servidor de origen.
+ * * Las respuestas informativas 1xx (salvo 101) se leen y se descartan con
+ * sus cabeceras, ya que el cliente no las pidió al proxy.
+ *
+ * @param status_line Búfer de salida (MAXBUF).
+ * @return Igual que readline().
+ */
+static int proxy_read_status(int up_fd, char *status_line) {
+    char line[MAXBUF];
+    while (1) {
+        ssize_t rc = readline(up_fd, status_line, MAXBUF);
+        int status = 0;
+        if (rc <= 0 || sscanf(status_line, "HTTP/%*d.%*d %d", &status) != 1 || status < 100 || status >= 200 ||
+            status == 101) {
+            return rc;
+        }
+        do {
+            if ((rc = readline(up_fd, line, sizeof(line))) <= 0) {
+                return rc;
+            }
+        } while (strcmp(line, "\r\n") != 0 && strcmp(line, "\n") != 0);
+    }
+}
+
+/**
+ * @brief Indica si una cabecera es de salto a salto y no debe reenviarse.
+ */
+static int proxy_hop_by_hop(const char *line) {
+    static const char *names[] = { "Connection:", "Keep-Alive:", "Proxy-Connection:", "TE:", "Upgrade:" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strncasecmp(line, names[i], strlen(names[i])) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Añade una línea a un bloque de cabeceras.
+ *
+ * @return 0 en caso de éxito, -1 si el bloque no cabe.
+ */
+static int proxy_append(char *block, size_t *len, const char *line) {
+    size_t n = strlen(line);
+    if (*len + n >= PROXY_HEADERS_MAX) {
+        return -1;
+    }
+    memcpy(block + *len, line, n + 1);
+    *len += n;
+    return 0;
+}
+
+/**
+ * @brief Reenvía una petición a un servidor de origen y su respuesta al cliente.
+ * * Las cabeceras del cliente se reenvían sin las de salto a salto, con
+ * "Connection: keep-alive" y X-Forwarded-For. El cuerpo de la petición y el
+ * de la respuesta se copian por bloques sin almacenarlos completos. Si la
+ * respuesta está delimitada (Content-Length o chunked) y el servidor de
+ * origen no pidió cerrar, la conexión vuelve al pool de la ruta para la
+ * siguiente petición de cualquier trabajador. Al cliente se le responde con
+ * "Connection: close", igual que al resto de peticiones del servidor.
+ *
+ * La línea de petición ya se leyó; las cabeceras se leen aquí.
+ *
+ * @param fd El descriptor de archivo de la conexión con el cliente.
+ * @param route_arg La ruta elegida por proxy_match().
+ * @param method El método de la petición.
+ * @param uri La URI de la petición.
+ * @return 0; la conexión con el cliente debe cerrarse.
+ */
+int proxy_handle(int fd, const proxy_route_t *route_arg, char *method, char *uri) {
+    proxy_route_t *route = (proxy_route_t *)route_arg;
+    char line[MAXBUF], head[PROXY_HEADERS_MAX];
+    size_t head_len = 0;
+    long long content_length = 0;
+    int chunked = 0, expect_continue = 0;
+
+    // Cabeceras de la petición
+    snprintf(line, sizeof(line), "%s %s HTTP/1.1\r\n", method, uri);
+    proxy_append(head, &head_len, line);
+    int too_large = 0, has_content_length = 0, bad_framing = 0;
+    while (1) {
+        if (readline(fd, line, sizeof(line)) <= 0) {
+            return 0;
+        }
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            long long value = atoll(line + 15);
+            if (value < 0 || (has_content_length && value != content_length)) {
+                bad_framing = 1;
+            }
+            content_length = value;
+            has_content_length = 1;
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            // Solo se sabe delimitar un cuerpo cuya última codificación es chunked.
+            if (strcasestr(line, "chunked")) {
+                chunked = 1;
+            } else {
+                bad_framing = 1;
+            }
+        } else if (strncasecmp(line, "Expect:", 7) == 0) {
+            // El proxy responde él mismo al 100-continue y después envía el cuerpo.
+            expect_continue = strcasestr(line, "100-continue") != NULL;
+            continue;
+        }
+        if (!proxy_hop_by_hop(line) && proxy_append(head, &head_len, line) < 0) {
+            too_large = 1;
+        }
+    }
+    trace_mark(TRACE_HEADERS);
+    // Content-Length junto a chunked (o un Content-Length inválido) haría que
+    // el servidor de origen delimitara el cuerpo de otra forma que el proxy y
+    // desincronizaría la conexión compartida del pool (RFC 9112, 6.3).
+    if (bad_framing || (chunked && has_content_length)) {
+        request_error(fd, uri, "400", "Bad Request", "conflicting or invalid request body framing");
+        return 0;
+    }
+    if (too_large) {
+        request_error(fd, uri, "431", "Request Header Fields Too Large", "request headers are too large to proxy");
+        return 0;
+    }
+
+    char client_ip[INET6_ADDRSTRLEN] = "unknown";
+    struct sockaddr_storage peer;
+    socklen_t peer_len = sizeof(peer);
+    if (getpeername(fd, (sockaddr_t *)&peer, &peer_len) == 0 && peer.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((struct sockaddr_in *)&peer)->sin_addr, client_ip, sizeof(client_ip));
+    }
+    snprintf(line, sizeof(line), "Connection: keep-alive\r\nX-Forwarded-For: %s\r\n\r\n", client_ip);
+    if (proxy_append(head, &head_len, line) < 0) {
+        request_error(fd, uri, "431", "Request Header Fields Too Large", "request headers are too large to proxy");
+        return 0;
+    }
+
+    pthread_mutex_lock(&route->mutex);
+    proxy_upstream_t *up = proxy_pick_locked(route);
+    pthread_mutex_unlock(&route->mutex);
+
+    // Envío de la petición. Si una conexión del pool resulta estar cerrada y
+    // la petición no tiene cuerpo, se repite una vez con una conexión nueva.
+    int has_body = chunked || content_length > 0;
+    if (expect_continue && has_body && send_all(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25) < 0) {
+        proxy_release(route, up, -1, 0);
+        return 0;
+    }
+    int up_fd = -1, reused = 0, status_rc = -1;
+    char status_line[MAXBUF];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        up_fd = proxy_checkout(route, up, &reused, attempt > 0);
+        if (up_fd < 0) {
+            break;
+        }
+				printf("[PROXY] %s %s -> %s (conexión %s)\n", method, uri, up->name, reused ? "reutilizada" : "nueva");
+        int send_rc = send_all(up_fd, head, head_len);
+        if (send_rc == 0 && has_body) {
+            send_rc = chunked ? proxy_copy_chunked(fd, up_fd, NULL) : proxy_copy(fd, up_fd, content_length, NULL);
+        }
+        if (send_rc == 0) {
+            status_rc = proxy_read_status(up_fd, status_line);
+        }
+        if (send_rc == 0 && status_rc > 0) {
+            break;
+        }
+        int timed_out = send_rc == 0 && status_rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        close_or_die(up_fd);
+        up_fd = -1;
+        if (!reused || has_body || timed_out) {
+            status_rc = timed_out ? -2 : -1;
+            break;
+        }
+    }
+
+    if (up_fd < 0) {
+        proxy_release(route, up, -1, 0);
+        if (status_rc == -2) {
+            request_error(fd, uri, "504", "Gateway Timeout", "upstream server did not answer in time");
+        } else {
+            request_error(fd, uri, "502", "Bad Gateway", "could not get a response from the upstream server");
+        }
+        return 0;
+    }
+
+    // Cabeceras de la respuesta
+    int status = 0, minor_version = 0;
+    sscanf(status_line, "HTTP/1.%d %d", &minor_version, &status);
+    int upstream_keep_alive = minor_version >= 1;
+    long long resp_length = -1;
+    int resp_chunked = 0;
+    head_len = 0;
+    proxy_append(head, &head_len, status_line);
+    while (1) {
+        if (readline(up_fd, line, sizeof(line)) <= 0) {
+            proxy_release(route, up, up_fd, 0);
+            request_error(fd, uri, "502", "Bad Gateway", "upstream server sent an incomplete response");
+            return 0;
+        }
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            resp_length = atoll(line + 15);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line, "chunked")) {
+            resp_chunked = 1;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            if (strcasestr(line, "close")) {
+                upstream_keep_alive = 0;
+            } else if (strcasestr(line, "keep-alive")) {
+                upstream_keep_alive = 1;
+            }
+        }
+        if (!proxy_hop_by_hop(line)) {
+            proxy_append(head, &head_len, line);
+        }
+    }
+    proxy_append(head, &head_len, "Connection: close\r\n\r\n");
+
+    // Cuerpo de la respuesta
+    int client_ok = send_all(fd, head, head_len) == 0;
+    trace_mark(TRACE_FIRST_BYTE);
+    uint64_t bytes = 0;
+    int body_rc = 0, delimited = 1;
+    if (strcasecmp(method, "HEAD") == 0 || (status >= 100 && status < 200) || status == 204 || status == 304) {
+        // Sin cuerpo.
+    } else if (!client_ok) {
+        body_rc = -2;
+    } else if (resp_chunked) {
+        body_rc = proxy_copy_chunked(up_fd, fd, &bytes);
+    } else if (resp_length >= 0) {
+        body_rc = proxy_copy(up_fd, fd, resp_length, &bytes);
+    } else {
+        // Sin delimitar: el cuerpo termina cuando el servidor de origen cierra.
+        delimited = 0;
+        char buf[PROXY_COPY_BUF];
+        ssize_t n;
+        while ((n = read(up_fd, buf, sizeof(buf))) > 0) {
+            if (send_all(fd, buf, n) < 0) {
+                break;
+            }
+            bytes += n;
+        }
+    }
+    trace_set_bytes(bytes);
+    trace_mark(TRACE_LAST_BYTE);
+
+    proxy_release(route, up, up_fd, client_ok && body_rc == 0 && delimited && upstream_keep_alive);
+    return 0;
+}
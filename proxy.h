@@ -0,0 +1,12 @@
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+// Una ruta de proxy inverso: un prefijo de URI y sus servidores de origen.
+typedef struct proxy_route proxy_route_t;
+
+int proxy_add_route(const char *spec);
+void proxy_configure(int least_conn, int timeout_ms);
+const proxy_route_t *proxy_match(const char *uri);
+int proxy_handle(int fd, const proxy_route_t *route, char *method, char *uri);
+
+#endif // __PROXY_H__
@@ -0,0 +1,224 @@
+#include "io_helper.h"
+#include "ratelimit.h"
+#include <time.h>
+
+// Solo el hilo maestro usa este módulo (al aceptar conexiones y al atender
+// SIGUSR1), así que la tabla y los contadores no necesitan cerrojos.
+
+#define RATELIMIT_BUCKETS (65536) // Cubos de la tabla.
+#define RATELIMIT_MAX_ENTRIES (1 << 17) // Clientes seguidos como máximo.
+#define RATELIMIT_TOP (10) // Clientes más limitados que muestra ratelimit_dump().
+
+#define KIND_IP (0)
+#define KIND_SUBNET (1)
+
+// Cubo de fichas de un cliente (una IP o una subred /24).
+typedef struct ratelimit_entry {
+    uint64_t key; // Tipo en los 32 bits altos, dirección en los bajos.
+    double tokens; // Fichas disponibles; cada conexión consume una.
+    uint64_t last_ns; // Última recarga.
+    uint64_t allowed; // Conexiones aceptadas.
+    uint64_t throttled; // Conexiones rechazadas con 429.
+    struct ratelimit_entry *next; // Siguiente entrada del mismo cubo.
+} ratelimit_entry_t;
+
+// Límite de un tipo de clave: fichas por segundo y tamaño de la ráfaga.
+typedef struct {
+    double rate; // 0 = sin límite para este tipo.
+    double burst;
+    uint64_t idle_ns; // Tras este tiempo sin conexiones el cubo está lleno y se descarta.
+} ratelimit_limit_t;
+
+static ratelimit_entry_t *buckets[RATELIMIT_BUCKETS];
+static ratelimit_limit_t limits[2];
+static int enabled_global;
+
+// Contadores globales.
+static uint64_t total_allowed;
+static uint64_t total_throttled[2];
+static uint64_t total_expired;
+static uint64_t total_untracked; // Aceptadas sin seguimiento por tener la tabla llena.
+static int total_entries;
+
+/**
+ * @brief Lee el reloj monotónico en nanosegundos.
+ */
+static uint64_t ratelimit_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Mezcla los bits de una clave (finalizador de splitmix64).
+ */
+static uint64_t ratelimit_hash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+/**
+ * @brief Activa la limitación por cliente.
+ * * Cada IP y cada subred /24 tienen un cubo de fichas que se recarga a
+ * rate fichas por segundo hasta burst. Una tasa 0 desactiva ese nivel.
+ *
+ * @return 0 en caso de éxito.
+ */
+int ratelimit_init(double ip_rate, double ip_burst, double subnet_rate, double subnet_burst) {
+    double rates[2] = { ip_rate, subnet_rate }, bursts[2] = { ip_burst, subnet_burst };
+
+    for (int k = 0; k < 2; k++) {
+        limits[k].rate = rates[k];
+        limits[k].burst = bursts[k] >= 1 ? bursts[k] : 1;
+        // Un cubo sin uso durante burst/rate segundos vuelve a estar lleno,
+        // que es lo mismo que no tener entrada.
+        limits[k].idle_ns = rates[k] > 0 ? (uint64_t)(limits[k].burst / rates[k] * 1e9) + 1000000000ULL : 0;
+        if (rates[k] > 0) {
+            printf("Límite por %s: %.1f conexiones/s, ráfaga de %.0f\n", k == KIND_IP ? "IP" : "subred /24",
+                   limits[k].rate, limits[k].burst);
+        }
+    }
+    enabled_global = ip_rate > 0 || subnet_rate > 0;
+    return 0;
+}
+
+/**
+ * @brief Indica si la limitación por cliente está activa.
+ */
+int ratelimit_enabled(void) {
+    return enabled_global;
+}
+
+/**
+ * @brief Consulta (y si se permite, consume) una ficha del cubo de una clave.
+ * * Las entradas caducadas que se encuentran al recorrer el cubo de la
+ * tabla se eliminan, de modo que la tabla no necesita un hilo de limpieza.
+ *
+ * @param consume 1 para consumir la ficha si hay una disponible.
+ * @return 1 si hay una ficha disponible (o la clave no se puede seguir), 0 si no.
+ */
+static int ratelimit_take(int kind, uint32_t addr, uint64_t now, int consume) {
+    const ratelimit_limit_t *limit = &limits[kind];
+    uint64_t key = ((uint64_t)kind << 32) | addr;
+    ratelimit_entry_t **pp = &buckets[ratelimit_hash(key) % RATELIMIT_BUCKETS];
+    ratelimit_entry_t *found = NULL;
+    int ok = 1;
+
+    while (*pp != NULL) {
+        ratelimit_entry_t *e = *pp;
+        if (e->key == key) {
+            found = e;
+        } else if (now - e->last_ns > limits[e->key >> 32].idle_ns) {
+            *pp = e->next;
+            free(e);
+            total_entries--;
+            total_expired++;
+            continue;
+        }
+        pp = &e->next;
+    }
+
+    if (found == NULL) {
+        if (total_entries >= RATELIMIT_MAX_ENTRIES || (found = calloc(1, sizeof(ratelimit_entry_t))) == NULL) {
+            total_untracked += consume;
+            return 1;
+        }
+        found->key = key;
+        found->tokens = limit->burst;
+        found->last_ns = now;
+        found->next = NULL;
+        *pp = found;
+        total_entries++;
+    }
+
+    found->tokens += (now - found->last_ns) / 1e9 * limit->rate;
+    if (found->tokens > limit->burst) {
+        found->tokens = limit->burst;
+    }
+    found->last_ns = now;
+    if (found->tokens < 1) {
+        found->throttled++;
+        ok = 0;
+    } else if (consume) {
+        found->tokens -= 1;
+        found->allowed++;
+    }
+    return ok;
+}
+
+/**
+ * @brief Decide si se acepta una conexión nueva de una dirección.
+ * * Se comprueba primero la IP sin consumir la ficha, después la subred y,
+ * solo si ambas tienen ficha, se consume la de la IP. Así una IP
+ * rechazada por su subred no pierde su cupo.
+ *
+ * @param addr La dirección IPv4 del cliente, en orden de red.
+ * @return RATELIMIT_ALLOW o el motivo del rechazo.
+ */
+int ratelimit_allow(uint32_t addr) {
+    uint64_t now = ratelimit_now_ns();
+    uint32_t host = ntohl(addr);
+
+    if (limits[KIND_IP].rate > 0 && !ratelimit_take(KIND_IP, host, now, 0)) {
+        total_throttled[KIND_IP]++;
+        return RATELIMIT_THROTTLE_IP;
+    }
+    if (limits[KIND_SUBNET].rate > 0 && !ratelimit_take(KIND_SUBNET, host & 0xffffff00u, now, 1)) {
+        total_throttled[KIND_SUBNET]++;
+        return RATELIMIT_THROTTLE_SUBNET;
+    }
+    if (limits[KIND_IP].rate > 0) {
+        ratelimit_take(KIND_IP, host, now, 1);
+    }
+    total_allowed++;
+    return RATELIMIT_ALLOW;
+}
+
+/**
+ * @brief Muestra los contadores y los clientes más limitados.
+ * * La invoca el maestro al recibir SIGUSR1.
+ */
+void ratelimit_dump(void) {
+    ratelimit_entry_t top[RATELIMIT_TOP];
+    int top_count = 0;
+
+    printf("[RATELIMIT] aceptadas=%llu rechazadas_ip=%llu rechazadas_subred=%llu sin_seguimiento=%llu "
+           "clientes=%d caducados=%llu\n",
+           (unsigned long long)total_allowed, (unsigned long long)total_throttled[KIND_IP],
+           (unsigned long long)total_throttled[KIND_SUBNET], (unsigned long long)total_untracked, total_entries,
+           (unsigned long long)total_expired);
+
+    for (int b = 0; b < RATELIMIT_BUCKETS; b++) {
+        for (ratelimit_entry_t *e = buckets[b]; e != NULL; e = e->next) {
+            if (e->throttled == 0) {
+                continue;
+            }
+            // Inserción ordenada en el top por conexiones rechazadas.
+            int pos;
+            if (top_count < RATELIMIT_TOP) {
+                pos = top_count++;
+            } else if (top[RATELIMIT_TOP - 1].throttled >= e->throttled) {
+                continue;
+            } else {
+                pos = RATELIMIT_TOP - 1;
+            }
+            while (pos > 0 && top[pos - 1].throttled < e->throttled) {
+                top[pos] = top[pos - 1];
+                pos--;
+            }
+            top[pos] = *e;
+        }
+    }
+
+    for (int i = 0; i < top_count; i++) {
+        struct in_addr in = { .s_addr = htonl((uint32_t)top[i].key) };
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        printf("[RATELIMIT]   %s%s: rechazadas=%llu aceptadas=%llu\n", ip, (top[i].key >> 32) ? "/24" : "",
+               (unsigned long long)top[i].throttled, (unsigned long long)top[i].allowed);
+    }
+    fflush(stdout);
+}
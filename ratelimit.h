@@ -0,0 +1,16 @@
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__
+
+#include <stdint.h>
+
+// Resultado de ratelimit_allow().
+#define RATELIMIT_ALLOW (0)
+#define RATELIMIT_THROTTLE_IP (1) // Se agotó el cubo de la IP.
+#define RATELIMIT_THROTTLE_SUBNET (2) // Se agotó el cubo de su subred /24.
+
+int ratelimit_init(double ip_rate, double ip_burst, double subnet_rate, double subnet_burst);
+int ratelimit_enabled(void);
+int ratelimit_allow(uint32_t addr);
+void ratelimit_dump(void);
+
+#endif // __RATELIMIT_H__
@@ -0,0 +1,180 @@
+#include "io_helper.h"
+#include "reload.h"
+#include <poll.h>
+#include <sys/wait.h>
+
+#define RELOAD_READY ('R') // Byte que envía el proceso nuevo cuando ya acepta conexiones.
+
+static int inherited_fd = -1; // En el proceso nuevo: socket hacia el anterior.
+
+/**
+ * @brief Arranca el proceso que sustituye al servidor y le pasa los sockets
+ * de escucha.
+ * * El proceso nuevo hereda solo un extremo de un socketpair, cuyo número
+ * recibe en RELOAD_ENV; los sockets de escucha viajan por él con SCM_RIGHTS.
+ *
+ * @param exe La ruta del binario (se vuelve a leer del disco).
+ * @param argv Los argumentos originales del servidor.
+ * @param cwd El directorio desde el que se lanzó el servidor, para que las
+ * rutas relativas de los argumentos sigan siendo válidas.
+ * @param fds Los sockets de escucha: HTTP y, si lo hay, HTTPS.
+ * @param num_fds El número de sockets (1 o 2).
+ * @param ready_fd Salida: el socket por el que avisará el proceso nuevo.
+ * @return El pid del proceso nuevo, o -1 en caso de error.
+ */
+pid_t reload_spawn(const char *exe, char *const argv[], const char *cwd, const int *fds, int num_fds,
+                   int *ready_fd) {
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close_or_die(sv[0]);
+        close_or_die(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        char value[16];
+        sigset_t none;
+
+        close(sv[0]);
+        fcntl(sv[1], F_SETFD, 0);
+        snprintf(value, sizeof(value), "%d", sv[1]);
+        setenv(RELOAD_ENV, value, 1);
+        // El maestro tiene las señales bloqueadas fuera de ppoll() y la
+        // máscara se hereda a través de exec().
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        if (chdir(cwd) < 0) {
+            perror(cwd);
+            _exit(1);
+        }
+        execv(exe, argv);
+        perror(exe);
+        _exit(127);
+    }
+    close_or_die(sv[1]);
+
+    // El byte de datos indica cuántos sockets se envían.
+    char count = (char)num_fds;
+    struct iovec iov = { .iov_base = &count, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * RELOAD_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+    if (sendmsg(sv[0], &msg, MSG_NOSIGNAL) < 0) {
+        perror("sendmsg(SCM_RIGHTS)");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close_or_die(sv[0]);
+        return -1;
+    }
+    *ready_fd = sv[0];
+    return pid;
+}
+
+/**
+ * @brief Espera a que el proceso nuevo esté aceptando conexiones.
+ * * Si no avisa a tiempo (o termina antes), se detiene y se recoge, de modo
+ * que nunca quedan dos servidores activos.
+ *
+ * @param ready_fd El socket devuelto por reload_spawn(); se cierra.
+ * @param pid El pid del proceso nuevo.
+ * @param timeout_ms El tiempo máximo de espera.
+ * @return 0 si el proceso nuevo está listo, -1 si no.
+ */
+int reload_wait_ready(int ready_fd, pid_t pid, int timeout_ms) {
+    struct pollfd pfd = { .fd = ready_fd, .events = POLLIN };
+    char c = 0;
+    int rc;
+
+    do {
+        rc = poll(&pfd, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    if (rc > 0 && read(ready_fd, &c, 1) == 1 && c == RELOAD_READY) {
+        close_or_die(ready_fd);
+        return 0;
+    }
+    close_or_die(ready_fd);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/**
+ * @brief Recibe los sockets de escucha si este proceso sustituye a otro.
+ *
+ * @param fds Salida: los sockets recibidos (HTTP y, si lo hay, HTTPS).
+ * @param max_fds La capacidad de fds.
+ * @return El número de sockets recibidos, 0 si el servidor arranca sin
+ * proceso anterior, o -1 en caso de error.
+ */
+int reload_inherit(int *fds, int max_fds) {
+    const char *value = getenv(RELOAD_ENV);
+    if (value == NULL) {
+        return 0;
+    }
+    inherited_fd = atoi(value);
+    // Los CGI no deben ver la variable.
+    unsetenv(RELOAD_ENV);
+    fcntl(inherited_fd, F_SETFD, FD_CLOEXEC);
+
+    char count = 0;
+    struct iovec iov = { .iov_base = &count, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * RELOAD_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(inherited_fd, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        perror("recvmsg(SCM_RIGHTS)");
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || count < 1 ||
+        count > max_fds || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * count)) {
+        fprintf(stderr, "Mensaje de recarga no válido\n");
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+    printf("Recibidos %d sockets de escucha del proceso anterior\n", count);
+    return count;
+}
+
+/**
+ * @brief Avisa al proceso anterior de que este ya acepta conexiones.
+ * * No hace nada si el servidor no arrancó por una recarga.
+ */
+void reload_notify_ready(void) {
+    char c = RELOAD_READY;
+
+    if (inherited_fd < 0) {
+        return;
+    }
+    if (write(inherited_fd, &c, 1) != 1) {
+        perror("write(reload)");
+    }
+    close_or_die(inherited_fd);
+    inherited_fd = -1;
+}
@@ -0,0 +1,21 @@
+#ifndef __RELOAD_H__
+#define __RELOAD_H__
+
+#include <sys/types.h>
+
+// --- Recarga sin cortes ---
+// Con SIGHUP el servidor arranca una copia nueva de sí mismo (leyendo de
+// nuevo el binario y la configuración) y le pasa sus sockets de escucha por
+// un socket Unix con SCM_RIGHTS. Cuando la copia nueva está lista para
+// aceptar, el proceso anterior deja de hacerlo y termina lo que tenía.
+
+#define RELOAD_ENV "WSERVER_RELOAD_FD" // Socket Unix heredado por el proceso nuevo.
+#define RELOAD_MAX_FDS (2) // Sockets de escucha HTTP y HTTPS.
+
+pid_t reload_spawn(const char *exe, char *const argv[], const char *cwd, const int *fds, int num_fds,
+                   int *ready_fd);
+int reload_wait_ready(int ready_fd, pid_t pid, int timeout_ms);
+int reload_inherit(int *fds, int max_fds);
+void reload_notify_ready(void);
+
+#endif // __RELOAD_H__
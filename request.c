@@ -1,5 +1,15 @@
+#define _GNU_SOURCE
 #include "io_helper.h"
 #include "request.h"
+#include "transfer.h"
+#include "http2.h"
+#include "cgi_cache.h"
+#include "pack.h"
+#include "plugin.h"
+#include "proxy.h"
+#include "trace.h"
+#include "mempool.h"
+#include "mime.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +19,7 @@
 #include <fcntl.h>
 
 #define MAXBUF (8192)
+#define MAXBODY (16 * 1024 * 1024) // Tamaño máximo del cuerpo de un POST.
 
 /**
  * @brief Envía una página de error HTTP formateada al cliente.
@@ -38,6 +49,7 @@ void request_error(int fd, char *cause, char *errnum, char *shortmsg, char *long
     
     sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
     write_or_die(fd, buf, strlen(buf));
+    trace_mark(TRACE_FIRST_BYTE);
     
     sprintf(buf, "Content-Type: text/html\r\n");
     write_or_die(fd, buf, strlen(buf));
@@ -46,31 +58,73 @@ void request_error(int fd, char *cause, char *errnum, char *shortmsg, char *long
     write_or_die(fd, buf, strlen(buf));
     
     write_or_die(fd, body, strlen(body));
+    trace_set_bytes(strlen(body));
+    trace_mark(TRACE_LAST_BYTE);
+}
+
+/**
+ * @brief Deja las señales de un proceso CGI como las de un proceso nuevo.
+ * * El hijo hereda de su trabajador la máscara que bloquea las señales del
+ * ciclo de vida y SIGPIPE ignorada, y ambas sobreviven a exec().
+ */
+static void cgi_reset_signals(void) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    signal(SIGPIPE, SIG_DFL);
 }
 
 /**
  * @brief Lee los encabezados de una petición HTTP y extrae el valor de Content-Length.
  * * Itera sobre todas las líneas de encabezado de una petición HTTP hasta encontrar
  * una línea vacía. Durante la iteración, busca específicamente el encabezado 
- * "Content-Length" y, si lo encuentra, almacena su valor numérico.
+ * "Content-Length" y, si lo encuentra, almacena su valor numérico. También
+ * detecta si el cliente pide cambiar a HTTP/2 en claro ("Upgrade: h2c") y
+ * las cabeceras que usa el contenido servido desde un paquete.
  *
  * @param fd El descriptor de archivo de la conexión.
+ * @param h2_settings Búfer de salida opcional (MAXBUF). Si la petición pide
+ * "Upgrade: h2c", recibe el valor de HTTP2-Settings; si no, queda vacío.
+ * @param accept_gzip Salida opcional: 1 si Accept-Encoding incluye gzip.
+ * @param if_none_match Búfer de salida opcional (MAXBUF) para If-None-Match.
  * @return El valor del Content-Length si se encuentra; de lo contrario, 0.
  */
-int request_parse_headers(int fd) {
+int request_parse_headers(int fd, char *h2_settings, int *accept_gzip, char *if_none_match) {
     char buf[MAXBUF];
-    char key[MAXBUF];
+    char key[MAXBUF], value[MAXBUF];
     int len = 0;
+    int upgrade_h2c = 0;
     
+    if (h2_settings) {
+        h2_settings[0] = '\0';
+    }
+    if (accept_gzip) {
+        *accept_gzip = 0;
+    }
+    if (if_none_match) {
+        if_none_match[0] = '\0';
+    }
     readline_or_die(fd, buf, MAXBUF);
     while (strcmp(buf, "\r\n")) {
         if (sscanf(buf, "%[^:]: %d", key, &len) == 2) {
             if (strcasecmp(key, "Content-Length") == 0) {
             }
-        } else {
+        } else if (sscanf(buf, "%[^:]: %[^\r\n]", key, value) == 2) {
+            if (h2_settings && strcasecmp(key, "Upgrade") == 0 && strcasecmp(value, "h2c") == 0) {
+                upgrade_h2c = 1;
+            } else if (h2_settings && strcasecmp(key, "HTTP2-Settings") == 0) {
+                strcpy(h2_settings, value);
+            } else if (accept_gzip && strcasecmp(key, "Accept-Encoding") == 0) {
+                *accept_gzip = strcasestr(value, "gzip") != NULL;
+            } else if (if_none_match && strcasecmp(key, "If-None-Match") == 0) {
+                strcpy(if_none_match, value);
+            }
         }
         readline_or_die(fd, buf, MAXBUF);
     }
+    if (h2_settings && !upgrade_h2c) {
+        h2_settings[0] = '\0';
+    }
     return len;
 }
 
@@ -106,29 +160,6 @@ int request_parse_uri(char *uri, char *filename, char *cgiargs) {
     }
 }
 
-/**
- * @brief Determina el tipo MIME de un archivo basado en su extensión.
- *
- * @param filename El nombre del archivo.
- * @param filetype Búfer de salida donde se almacenará el string del tipo MIME.
- */
-void request_get_filetype(char *filename, char *filetype) {
-    if (strstr(filename, ".html")) 
-	strcpy(filetype, "text/html");
-    else if (strstr(filename, ".gif")) 
-	strcpy(filetype, "image/gif");
-    else if (strstr(filename, ".jpg")) 
-	strcpy(filetype, "image/jpeg");
-    else if (strstr(filename, ".pdf"))
-    strcpy(filetype, "application/pdf");
-    else if (strstr(filename, ".css"))
-    strcpy(filetype, "text/css");   
-    else if (strstr(filename, ".js"))
-    strcpy(filetype, "application/javascript");
-    else 
-	strcpy(filetype, "text/plain");
-}
-
 /**
  * @brief Sirve una petición de contenido dinámico (CGI) que utiliza el método POST.
  * * Crea un proceso hijo para ejecutar el script CGI. Utiliza una tubería (pipe)
@@ -146,6 +177,7 @@ void request_serve_dynamic_post(int fd, char *filename, char *cgiargs, char *pos
 
     sprintf(buf, "HTTP/1.0 200 OK\r\nServer: OSTEP WebServer\r\n");
     write_or_die(fd, buf, strlen(buf));
+    trace_mark(TRACE_FIRST_BYTE);
 
     int pipe_to_cgi[2];
     if (pipe(pipe_to_cgi) < 0) {
@@ -166,6 +198,7 @@ void request_serve_dynamic_post(int fd, char *filename, char *cgiargs, char *pos
         
         dup2_or_die(fd, STDOUT_FILENO);
         extern char **environ;
+        cgi_reset_signals();
         execve_or_die(filename, argv, environ);
     } else {
         close(pipe_to_cgi[0]);
@@ -175,13 +208,93 @@ void request_serve_dynamic_post(int fd, char *filename, char *cgiargs, char *pos
         close(pipe_to_cgi[1]);
         
         wait_or_die(NULL);
+        trace_mark(TRACE_LAST_BYTE);
     }
 }
 
+/**
+ * @brief Ejecuta un programa CGI y captura toda su salida en memoria.
+ * * A diferencia de request_serve_dynamic(), la salida del CGI no va
+ * directamente al cliente sino a una tubería, lo que permite reenviarla por
+ * otros protocolos (HTTP/2).
+ *
+ * @param filename La ruta del script CGI a ejecutar.
+ * @param cgiargs Los argumentos de la query string.
+ * @param post_data El cuerpo de la petición POST, o NULL.
+ * @param content_length El tamaño de post_data.
+ * @param out_len Salida: el número de bytes capturados.
+ * @return Un búfer reservado con malloc() con la salida completa del CGI
+ * (cabeceras CGI incluidas) terminada en '\0', o NULL en caso de error.
+ */
+char *request_cgi_capture(char *filename, char *cgiargs, char *post_data, int content_length, size_t *out_len) {
+    char *argv[] = { NULL };
+    int pipe_to_cgi[2], pipe_from_cgi[2];
+
+    if (pipe(pipe_to_cgi) < 0) {
+        return NULL;
+    }
+    if (pipe(pipe_from_cgi) < 0) {
+        close_or_die(pipe_to_cgi[0]);
+        close_or_die(pipe_to_cgi[1]);
+        return NULL;
+    }
+
+    pid_t pid = fork_or_die();
+    if (pid == 0) {
+        close(pipe_to_cgi[1]);
+        close(pipe_from_cgi[0]);
+        dup2_or_die(pipe_to_cgi[0], STDIN_FILENO);
+        dup2_or_die(pipe_from_cgi[1], STDOUT_FILENO);
+
+        char len_str[20];
+        sprintf(len_str, "%d", content_length);
+        setenv_or_die("QUERY_STRING", cgiargs, 1);
+        setenv_or_die("CONTENT_LENGTH", len_str, 1);
+
+        extern char **environ;
+        cgi_reset_signals();
+        execve_or_die(filename, argv, environ);
+    }
+
+    close_or_die(pipe_to_cgi[0]);
+    close_or_die(pipe_from_cgi[1]);
+    if (post_data != NULL && content_length > 0) {
+        write_or_die(pipe_to_cgi[1], post_data, content_length);
+    }
+    close_or_die(pipe_to_cgi[1]);
+
+    size_t cap = MAXBUF, len = 0;
+    char *out = malloc(cap);
+    ssize_t n;
+    while (out != NULL && (n = read(pipe_from_cgi[0], out + len, cap - len)) > 0) {
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            char *bigger = realloc(out, cap);
+            if (bigger == NULL) {
+                free(out);
+            }
+            out = bigger;
+        }
+    }
+    close_or_die(pipe_from_cgi[0]);
+    waitpid(pid, NULL, 0);
+
+    // Siempre queda al menos un byte libre: se termina en '\0' para poder
+    // buscar el fin de las cabeceras con las funciones de cadenas.
+    if (out != NULL) {
+        out[len] = '\0';
+    }
+    *out_len = len;
+    return out;
+}
+
 /**
  * @brief Sirve una petición de contenido dinámico (CGI) que utiliza el método GET.
  * * Crea un proceso hijo para ejecutar el script CGI. Pasa los argumentos de la
- * query string a través de la variable de entorno QUERY_STRING.
+ * query string a través de la variable de entorno QUERY_STRING. Con la caché
+ * de CGI activada la salida se obtiene de cgi_cache_get(), que evita lanzar
+ * el programa si ya hay una respuesta vigente o en curso.
  *
  * @param fd El descriptor de archivo de la conexión.
  * @param filename La ruta del script CGI a ejecutar.
@@ -195,14 +308,29 @@ void request_serve_dynamic(int fd, char *filename, char *cgiargs) {
 	    "Server: OSTEP WebServer\r\n");
     
     write_or_die(fd, buf, strlen(buf));
+    trace_mark(TRACE_FIRST_BYTE);
+
+    if (cgi_cache_enabled()) {
+        size_t out_len;
+        char *out = cgi_cache_get(filename, cgiargs, &out_len);
+        if (out != NULL) {
+            write_or_die(fd, out, out_len);
+            trace_set_bytes(out_len);
+            free(out);
+        }
+        trace_mark(TRACE_LAST_BYTE);
+        return;
+    }
     
     if (fork_or_die() == 0) {
 	setenv_or_die("QUERY_STRING", cgiargs, 1);
 	dup2_or_die(fd, STDOUT_FILENO);
 	extern char **environ;
+	cgi_reset_signals();
 	execve_or_die(filename, argv, environ);
     } else {
 	wait_or_die(NULL);
+	trace_mark(TRACE_LAST_BYTE);
     }
 }
 
@@ -215,12 +343,14 @@ void request_serve_dynamic(int fd, char *filename, char *cgiargs) {
  * @param fd El descriptor de archivo de la conexión.
  * @param filename La ruta del archivo a servir.
  * @param filesize El tamaño del archivo en bytes.
+ * @return 1 si la conexión quedó a cargo del motor de transmisiones por
+ * partes (archivos grandes), 0 si la respuesta ya se envió completa.
  */
-void request_serve_static(int fd, char *filename, int filesize) {
+int request_serve_static(int fd, char *filename, int filesize) {
     int srcfd;
     char *srcp, filetype[MAXBUF], buf[MAXBUF];
     
-    request_get_filetype(filename, filetype);
+    mime_get_filetype(filename, filetype);
     srcfd = open_or_die(filename, O_RDONLY, 0);
     
     srcp = mmap_or_die(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);
@@ -234,9 +364,76 @@ void request_serve_static(int fd, char *filename, int filesize) {
 	    filesize, filetype);
     
     write_or_die(fd, buf, strlen(buf));
+    trace_mark(TRACE_FIRST_BYTE);
+    trace_set_bytes(filesize);
+
+    // Los archivos grandes se envían por turnos para no acaparar el hilo.
+    if (transfer_enabled(filesize)) {
+        transfer_start(fd, srcp, filesize, 1);
+        return 1;
+    }
     
     write_or_die(fd, srcp, filesize);
+    trace_mark(TRACE_LAST_BYTE);
     munmap_or_die(srcp, filesize);
+    return 0;
+}
+
+/**
+ * @brief Sirve un archivo estático desde el paquete de contenido.
+ * * Equivale a request_serve_static() sin ninguna llamada al sistema de
+ * archivos: el tipo MIME y el ETag vienen precalculados y el cuerpo se envía
+ * directamente desde la región mapeada. Si el cliente ya tiene la versión
+ * actual (If-None-Match) se responde 304, y si acepta gzip y el paquete
+ * tiene una variante comprimida se envía esa.
+ *
+ * @param fd El descriptor de archivo de la conexión.
+ * @param e La entrada del archivo en el paquete.
+ * @param accept_gzip 1 si el cliente acepta Content-Encoding gzip.
+ * @param if_none_match El valor de If-None-Match de la petición, o "".
+ * @return 1 si la conexión quedó a cargo del motor de transmisiones por
+ * partes, 0 si la respuesta ya se envió completa.
+ */
+int request_serve_pack(int fd, const pack_entry_t *e, int accept_gzip, const char *if_none_match) {
+    char buf[MAXBUF];
+
+    if (pack_not_modified(e, if_none_match)) {
+        sprintf(buf, ""
+                "HTTP/1.0 304 Not Modified\r\n"
+                "Server: OSTEP WebServer\r\n"
+                "ETag: %s\r\n\r\n", e->etag);
+        write_or_die(fd, buf, strlen(buf));
+        trace_mark(TRACE_FIRST_BYTE);
+        trace_mark(TRACE_LAST_BYTE);
+        return 0;
+    }
+
+    const char *data;
+    size_t size;
+    int gzip = pack_variant(e, accept_gzip, &data, &size);
+
+    sprintf(buf, ""
+            "HTTP/1.0 200 OK\r\n"
+            "Server: OSTEP WebServer\r\n"
+            "Content-Length: %zu\r\n"
+            "Content-Type: %s\r\n"
+            "ETag: %s\r\n"
+            "%s%s\r\n",
+            size, pack_at(e->mime_off), e->etag,
+            gzip ? "Content-Encoding: gzip\r\n" : "",
+            e->gzip_size > 0 ? "Vary: Accept-Encoding\r\n" : "");
+    write_or_die(fd, buf, strlen(buf));
+    trace_mark(TRACE_FIRST_BYTE);
+    trace_set_bytes(size);
+
+    // El paquete sigue mapeado: la transmisión no debe liberar la región.
+    if (transfer_enabled(size)) {
+        transfer_start(fd, (char *)data, size, 0);
+        return 1;
+    }
+    write_or_die(fd, data, size);
+    trace_mark(TRACE_LAST_BYTE);
+    return 0;
 }
 
 /**
@@ -248,71 +445,145 @@ void request_serve_static(int fd, char *filename, int filesize) {
  *
  * @param fd El descriptor de archivo de la conexión del cliente.
  * @param root_dir El directorio raíz del servidor.
+ * @return 1 si la conexión quedó a cargo del motor de transmisiones y el
+ * llamador no debe cerrarla, 0 en caso contrario.
  */
-void request_handle(int fd, const char *root_dir) {
+int request_handle(int fd, const char *root_dir) {
     (void)root_dir; 
     int is_static;
     struct stat sbuf;
-    char buf[MAXBUF], method[MAXBUF], uri[MAXBUF], version[MAXBUF];
-    char filename[MAXBUF], cgiargs[MAXBUF];
+    // Todo lo que solo vive durante la petición sale de la arena del hilo,
+    // que el trabajador reinicia al terminar.
+    arena_t *arena = arena_thread();
+    char *buf = arena_alloc(arena, MAXBUF), *method = arena_alloc(arena, MAXBUF);
+    char *uri = arena_alloc(arena, MAXBUF), *version = arena_alloc(arena, MAXBUF);
+    char *filename = arena_alloc(arena, MAXBUF), *cgiargs = arena_alloc(arena, MAXBUF);
+    if (!buf || !method || !uri || !version || !filename || !cgiargs) {
+        request_error(fd, "request", "500", "Internal Server Error", "Memory allocation failed");
+        return 0;
+    }
     
     readline_or_die(fd, buf, MAXBUF);
     sscanf(buf, "%s %s %s", method, uri, version);
     printf("[REQUEST FD=%d] Manejando: Method=%s URI=%s Version=%s\n", fd, method, uri, version);
     fflush(stdout);
 
+    // HTTP/2 con conocimiento previo: la primera línea es el inicio del
+    // prefacio y el resto de la conexión lo atiende una sesión HTTP/2.
+    if (strcmp(method, "PRI") == 0 && strcmp(uri, "*") == 0 && strcmp(version, "HTTP/2.0") == 0) {
+        trace_set_flags(TRACE_F_HANDOFF);
+        return http2_start(fd, H2_PREFACE + strlen("PRI * HTTP/2.0\r\n"), NULL, NULL) == 0;
+    }
+
     if (strstr(uri, "..")) {
         request_error(fd, uri, "403", "Forbidden", "Path traversal attempt detected in URI.");
-        return;
+        return 0;
+    }
+
+    // Las rutas de proxy inverso se reenvían con cualquier método al
+    // servidor de origen, que lee también las cabeceras.
+    const proxy_route_t *route = proxy_match(uri);
+    if (route != NULL) {
+        trace_set_flags(TRACE_F_DYNAMIC);
+        return proxy_handle(fd, route, method, uri);
     }
 
     if (strcasecmp(method, "GET") != 0 && strcasecmp(method, "POST") != 0) {
         request_error(fd, method, "501", "Not Implemented", "server does not implement this method");
-        return;
+        return 0;
     }
     
-    int content_length = request_parse_headers(fd);
+    char *h2_settings = arena_alloc(arena, MAXBUF), *if_none_match = arena_alloc(arena, MAXBUF);
+    if (!h2_settings || !if_none_match) {
+        request_error(fd, "request", "500", "Internal Server Error", "Memory allocation failed");
+        return 0;
+    }
+    int accept_gzip;
+    int content_length = request_parse_headers(fd, h2_settings, &accept_gzip, if_none_match);
+    trace_mark(TRACE_HEADERS);
+
+    // Upgrade a HTTP/2 en claro (h2c). Solo se acepta para GET, ya que la
+    // respuesta a esta misma petición se envía como el stream 1.
+    if (h2_settings[0] != '\0' && strcasecmp(method, "GET") == 0) {
+        sprintf(buf, ""
+                "HTTP/1.1 101 Switching Protocols\r\n"
+                "Connection: Upgrade\r\n"
+                "Upgrade: h2c\r\n\r\n");
+        write_or_die(fd, buf, strlen(buf));
+        trace_set_flags(TRACE_F_HANDOFF);
+        return http2_start(fd, H2_PREFACE, uri, h2_settings) == 0;
+    }
     
     char *post_buffer = NULL;
     if (strcasecmp(method, "POST") == 0) {
-        if (content_length > 0) {
-            post_buffer = (char*)malloc(content_length + 1);
+        if (content_length > MAXBODY) {
+            request_error(fd, "POST", "413", "Payload Too Large", "request body exceeds the server limit");
+            return 0;
+        } else if (content_length > 0) {
+            post_buffer = arena_alloc(arena, content_length + 1);
             if (post_buffer == NULL) {
                 request_error(fd, "POST", "500", "Internal Server Error", "Memory allocation failed");
-                return;
+                return 0;
             }
             read_or_die(fd, post_buffer, content_length);
             post_buffer[content_length] = '\0';
         } else {
             request_error(fd, "POST", "411", "Length Required", "POST requests require a Content-Length header");
-            return;
+            return 0;
         }
     }
     
+    // Los manejadores de los plugins se ejecutan en este mismo hilo, sin
+    // crear procesos.
+    int plugin_route = plugin_match(uri);
+    if (plugin_route >= 0) {
+        trace_set_flags(TRACE_F_DYNAMIC);
+        plugin_handle(fd, plugin_route, method, uri, post_buffer, post_buffer ? content_length : 0);
+        return 0;
+    }
+
     is_static = request_parse_uri(uri, filename, cgiargs);
+    if (!is_static) {
+        trace_set_flags(TRACE_F_DYNAMIC);
+    }
+
+    // Con un paquete cargado el contenido estático se resuelve solo con su
+    // índice, sin tocar el sistema de archivos.
+    if (is_static && pack_loaded()) {
+        const pack_entry_t *entry = pack_lookup(filename);
+        trace_mark(TRACE_STAT);
+        if (entry == NULL) {
+            request_error(fd, filename, "404", "Not found", "server could not find this file");
+            return 0;
+        }
+        if (strcasecmp(method, "POST") == 0) {
+            request_error(fd, filename, "405", "Method Not Allowed", "POST method is not supported for static content");
+            return 0;
+        }
+        return request_serve_pack(fd, entry, accept_gzip, if_none_match);
+    }
 
-    if (stat(filename, &sbuf) < 0) {
+    int stat_rc = stat(filename, &sbuf);
+    trace_mark(TRACE_STAT);
+    if (stat_rc < 0) {
         request_error(fd, filename, "404", "Not found", "server could not find this file");
-        if (post_buffer) free(post_buffer);
-        return;
+        return 0;
     }
     
     if (is_static) {
         if (strcasecmp(method, "POST") == 0) {
             request_error(fd, filename, "405", "Method Not Allowed", "POST method is not supported for static content");
-            if (post_buffer) free(post_buffer);
-            return;
+            return 0;
         }
         if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) {
             request_error(fd, filename, "403", "Forbidden", "server could not read this file");
-            return;
+            return 0;
         }
-        request_serve_static(fd, filename, sbuf.st_size);
+        return request_serve_static(fd, filename, sbuf.st_size);
     } else {
         if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
             request_error(fd, filename, "403", "Forbidden", "server could not run this CGI program");
-            if (post_buffer) free(post_buffer);
-            return;
+            return 0;
         }
 
         if (strcasecmp(method, "POST") == 0) {
@@ -322,7 +593,5 @@ void request_handle(int fd, const char *root_dir) {
         }
     }
 
-    if (post_buffer) {
-        free(post_buffer);
-    }
+    return 0;
 }
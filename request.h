@@ -1,9 +1,16 @@
 
 #ifndef __REQUEST_H__
+#define __REQUEST_H__
 
-void request_handle(int fd, const char *root_dir);
+#include <stddef.h>
 
-int request_parse_headers(int fd);
+int request_handle(int fd, const char *root_dir);
+void request_error(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
+
+int request_parse_headers(int fd, char *h2_settings, int *accept_gzip, char *if_none_match);
+int request_parse_uri(char *uri, char *filename, char *cgiargs);
+int request_serve_static(int fd, char *filename, int filesize);
 void request_serve_dynamic_post(int fd, char *filename, char *cgiargs, char *post_data, int content_length);
+char *request_cgi_capture(char *filename, char *cgiargs, char *post_data, int content_length, size_t *out_len);
 
 #endif // __REQUEST_H__
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "io_helper.h"
+#include "sched.h"
+
+request_entry_t *requests_buffer; // Búfer compartido para las peticiones.
+int buffer_slots_global; // Capacidad del búfer.
+char *sched_alg_global; // Algoritmo de planificación (FIFO, SFF, SEJF o CLASS).
+const sched_policy_t *sched_policy; // Implementación de sched_alg_global.
+
+volatile int buffer_count_global; // Número actual de peticiones en el búfer.
+int buffer_in_idx; // Índice para añadir peticiones (productor).
+int buffer_out_idx; // Índice para sacar peticiones (consumidor).
+
+pthread_mutex_t buffer_mutex_global; // Mutex para proteger el acceso al búfer.
+pthread_cond_t buffer_not_full_cond; // Condición para cuando el búfer no está lleno.
+pthread_cond_t buffer_not_empty_cond; // Condición para cuando el búfer no está vacío.
+
+// --- Planificación por clases (política CLASS) ---
+// Cada clase tiene su propia cola circular. Los trabajadores reparten el
+// servicio entre clases con un round-robin por déficit (DRR) ponderado, y
+// cada clase tiene un tope de trabajadores que puede ocupar a la vez.
+static request_entry_t *class_queues[NUM_REQ_CLASSES]; // Colas por clase.
+static int class_count[NUM_REQ_CLASSES]; // Peticiones encoladas por clase.
+static int class_in_idx[NUM_REQ_CLASSES]; // Índice de inserción por clase.
+static int class_out_idx[NUM_REQ_CLASSES]; // Índice de extracción por clase.
+static int class_active[NUM_REQ_CLASSES]; // Trabajadores ocupados por clase.
+static int class_max_workers[NUM_REQ_CLASSES]; // Tope de trabajadores por clase.
+static int class_weight[NUM_REQ_CLASSES]; // Peticiones por ronda (quantum DRR).
+static int class_deficit[NUM_REQ_CLASSES]; // Crédito restante en la ronda actual.
+static int class_rr_current; // Clase que tiene el turno en el DRR.
+
+// --- Cola circular compartida (FIFO, SFF y SEJF) ---
+
+/**
+ * @brief Indica si la cola circular tiene alguna petición.
+ */
+static int ring_available_locked(void) {
+    return buffer_count_global > 0;
+}
+
+/**
+ * @brief Extrae la petición que está en la cabeza de la cola circular.
+ */
+static void ring_dequeue_locked(request_entry_t *entry) {
+    *entry = requests_buffer[buffer_out_idx];
+    entry->req_class = -1;
+    buffer_out_idx = (buffer_out_idx + 1) % buffer_slots_global;
+    buffer_count_global--;
+}
+
+/**
+ * @brief Inserta una petición al final de la cola circular.
+ */
+static int ring_enqueue_locked(const request_entry_t *entry) {
+    int enqueued_at_idx = buffer_in_idx;
+    requests_buffer[buffer_in_idx] = *entry;
+    buffer_in_idx = (buffer_in_idx + 1) % buffer_slots_global;
+    buffer_count_global++;
+    return enqueued_at_idx;
+}
+
+/**
+ * @brief Extrae una petición cualquiera de la cola circular.
+ * * La intercambia con la cabeza, de modo que la que estaba en la cabeza
+ * ocupa el hueco elegido.
+ *
+ * @param idx El índice de la petición dentro de requests_buffer.
+ */
+static void ring_dequeue_at_locked(request_entry_t *entry, int idx) {
+    if (idx != buffer_out_idx) {
+        request_entry_t temp = requests_buffer[buffer_out_idx];
+        requests_buffer[buffer_out_idx] = requests_buffer[idx];
+        requests_buffer[idx] = temp;
+    }
+    ring_dequeue_locked(entry);
+}
+
+/**
+ * @brief SFF: extrae la petición con el archivo más pequeño.
+ * * Recorre la cola buscando el menor tamaño conocido y lo intercambia con
+ * la cabeza. Las peticiones de tamaño desconocido (negativo) solo se sirven
+ * cuando no queda ninguna con tamaño conocido.
+ */
+static void sff_dequeue_locked(request_entry_t *entry) {
+    int SFF_chosen_idx_in_buffer_array = -1; 
+    off_t SFF_min_size = 0; 
+
+    for (int i = 0; i < buffer_count_global; i++) {
+        int current_item_actual_idx = (buffer_out_idx + i) % buffer_slots_global;
+        off_t current_size = requests_buffer[current_item_actual_idx].file_size_for_sff;
+
+        if (current_size >= 0) { 
+            if (SFF_chosen_idx_in_buffer_array == -1 || current_size < SFF_min_size) {
+                SFF_min_size = current_size;
+                SFF_chosen_idx_in_buffer_array = current_item_actual_idx;
+            }
+        }
+    }
+
+    if (SFF_chosen_idx_in_buffer_array == -1) { 
+        SFF_chosen_idx_in_buffer_array = buffer_out_idx; 
+    }
+    ring_dequeue_at_locked(entry, SFF_chosen_idx_in_buffer_array);
+}
+
+/**
+ * @brief SEJF: extrae la petición con el menor tiempo de servicio previsto.
+ * * El coste lo estima el modelo aprendido (costmodel.c) al encolar, así
+ * que todas las peticiones tienen uno; a igual coste se respeta el orden
+ * de llegada.
+ */
+static void sejf_dequeue_locked(request_entry_t *entry) {
+    int chosen = buffer_out_idx;
+    double min_cost = requests_buffer[buffer_out_idx].expected_cost;
+
+    for (int i = 1; i < buffer_count_global; i++) {
+        int idx = (buffer_out_idx + i) % buffer_slots_global;
+        if (requests_buffer[idx].expected_cost < min_cost) {
+            min_cost = requests_buffer[idx].expected_cost;
+            chosen = idx;
+        }
+    }
+    ring_dequeue_at_locked(entry, chosen);
+}
+
+// --- CLASS ---
+
+/**
+ * @brief Elige la clase de la que se debe servir la siguiente petición.
+ * * Implementa un round-robin por déficit con coste unitario: en cada ronda
+ * una clase puede servir hasta class_weight peticiones antes de ceder el
+ * turno. Se saltan las clases vacías y las que ya ocupan su tope de
+ * trabajadores.
+ *
+ * @return El índice de la clase elegida, o -1 si ninguna es elegible.
+ */
+static int class_pick_locked(void) {
+    for (int tries = 0; tries < 2 * NUM_REQ_CLASSES; tries++) {
+        int c = class_rr_current;
+        if (class_count[c] > 0 && class_active[c] < class_max_workers[c]) {
+            if (class_deficit[c] <= 0) {
+                class_deficit[c] += class_weight[c];
+            }
+            class_deficit[c]--;
+            if (class_deficit[c] <= 0) {
+                class_rr_current = (c + 1) % NUM_REQ_CLASSES;
+            }
+            return c;
+        }
+        if (class_count[c] == 0) {
+            class_deficit[c] = 0;
+        }
+        class_rr_current = (c + 1) % NUM_REQ_CLASSES;
+    }
+    return -1;
+}
+
+/**
+ * @brief CLASS: una petición solo es elegible si su clase no ha alcanzado
+ * el tope de trabajadores.
+ */
+static int class_available_locked(void) {
+    for (int c = 0; c < NUM_REQ_CLASSES; c++) {
+        if (class_count[c] > 0 && class_active[c] < class_max_workers[c]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief CLASS: extrae de la clase elegida por el DRR y ocupa su cupo.
+ */
+static void class_dequeue_locked(request_entry_t *entry) {
+    int c = class_pick_locked();
+    *entry = class_queues[c][class_out_idx[c]];
+    class_out_idx[c] = (class_out_idx[c] + 1) % buffer_slots_global;
+    class_count[c]--;
+    class_active[c]++;
+    buffer_count_global--;
+    entry->req_class = c;
+}
+
+/**
+ * @brief CLASS: inserta la petición en la cola de su clase.
+ */
+static int class_enqueue_locked(const request_entry_t *entry) {
+    int rc_class = entry->req_class;
+    int enqueued_at_idx = class_in_idx[rc_class];
+    class_queues[rc_class][class_in_idx[rc_class]] = *entry;
+    class_in_idx[rc_class] = (class_in_idx[rc_class] + 1) % buffer_slots_global;
+    class_count[rc_class]++;
+    buffer_count_global++;
+    return enqueued_at_idx;
+}
+
+/**
+ * @brief CLASS: libera el cupo de la clase de una petición terminada.
+ *
+ * @return 1 si la clase tiene peticiones que esperaban solo por el cupo.
+ */
+static int class_release_locked(const request_entry_t *entry) {
+    class_active[entry->req_class]--;
+    return class_count[entry->req_class] > 0;
+}
+
+static const sched_policy_t fifo_policy = {
+    "FIFO", SCHED_PEEK_NONE, ring_available_locked, ring_dequeue_locked, ring_enqueue_locked, NULL,
+};
+static const sched_policy_t sff_policy = {
+    "SFF", SCHED_PEEK_SIZE, ring_available_locked, sff_dequeue_locked, ring_enqueue_locked, NULL,
+};
+static const sched_policy_t sejf_policy = {
+    "SEJF", SCHED_PEEK_COST, ring_available_locked, sejf_dequeue_locked, ring_enqueue_locked, NULL,
+};
+static const sched_policy_t class_policy = {
+    "CLASS", SCHED_PEEK_CLASS, class_available_locked, class_dequeue_locked, class_enqueue_locked,
+    class_release_locked,
+};
+
+// Políticas disponibles para -s, terminadas en NULL.
+const sched_policy_t *sched_policies[] = { &fifo_policy, &sff_policy, &sejf_policy, &class_policy, NULL };
+
+/**
+ * @brief Busca una política por su nombre.
+ *
+ * @return La política, o NULL si no existe.
+ */
+const sched_policy_t *sched_policy_find(const char *name) {
+    for (int i = 0; sched_policies[i] != NULL; i++) {
+        if (strcmp(sched_policies[i]->name, name) == 0) {
+            return sched_policies[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Indica si hay alguna petición que un trabajador pueda tomar ahora.
+ * * Debe llamarse con buffer_mutex_global adquirido.
+ *
+ * @return 1 si hay una petición elegible, 0 si no.
+ */
+int requests_available_locked(void) {
+    return sched_policy->available();
+}
+
+/**
+ * @brief Extrae la siguiente petición según la política de planificación.
+ * * Debe llamarse con buffer_mutex_global adquirido y solo cuando
+ * requests_available_locked() indica que hay trabajo.
+ *
+ * @param entry Salida: la petición extraída. En CLASS, req_class indica la
+ * clase cuyo cupo de trabajadores se ocupó; en otro caso vale -1.
+ */
+void dequeue_request_locked(request_entry_t *entry) {
+    sched_policy->dequeue(entry);
+}
+
+/**
+ * @brief Inserta una petición en el búfer según la política de planificación.
+ * * Debe llamarse con buffer_mutex_global adquirido y con espacio libre en
+ * el búfer. No despierta a ningún trabajador.
+ *
+ * @param entry La petición a encolar.
+ * @return La posición en la que quedó dentro de su cola.
+ */
+int enqueue_request_locked(const request_entry_t *entry) {
+    return sched_policy->enqueue(entry);
+}
+
+/**
+ * @brief Avisa a la política de que un trabajador terminó una petición.
+ * * Solo hace falta para las peticiones con req_class >= 0. Debe llamarse
+ * con buffer_mutex_global adquirido.
+ *
+ * @param entry La petición tal como la devolvió dequeue_request_locked().
+ * @return 1 si alguna petición pasó a ser elegible y conviene despertar a
+ * un trabajador, 0 si no.
+ */
+int release_request_locked(const request_entry_t *entry) {
+    if (sched_policy->release == NULL) {
+        return 0;
+    }
+    return sched_policy->release(entry);
+}
+
+/**
+ * @brief Reserva el búfer de peticiones y configura la política de planificación.
+ *
+ * @param sched_alg El nombre de una de las políticas de sched_policies.
+ * @param slots La capacidad del búfer.
+ * @param num_threads El número de trabajadores (tope de la clase estática).
+ * @param weight_static Peticiones estáticas por ronda del DRR (CLASS).
+ * @param weight_dynamic Peticiones dinámicas por ronda del DRR (CLASS).
+ * @param max_dynamic_workers Tope de trabajadores atendiendo CGI (CLASS);
+ * 0 reserva al menos un hilo para el contenido estático.
+ * @return 0 en caso de éxito, -1 si la política no existe o no hay memoria.
+ */
+int sched_init(const char *sched_alg, int slots, int num_threads, int weight_static, int weight_dynamic,
+               int max_dynamic_workers) {
+    sched_policy = sched_policy_find(sched_alg);
+    if (sched_policy == NULL) {
+        fprintf(stderr, "Política de planificación desconocida: %s\n", sched_alg);
+        return -1;
+    }
+    buffer_slots_global = slots;
+    sched_alg_global = strdup(sched_alg);
+    requests_buffer = (request_entry_t *)malloc(sizeof(request_entry_t) * buffer_slots_global);
+    if (sched_alg_global == NULL || requests_buffer == NULL) {
+        perror("No se pudo asignar el búfer de solicitudes");
+        return -1;
+    }
+    buffer_count_global = 0;
+    buffer_in_idx = 0;
+    buffer_out_idx = 0;
+
+    // Colas por clase para la política CLASS. Cada cola puede llegar a
+    // contener el búfer completo; el límite global sigue siendo buffer_slots.
+    if (sched_policy == &class_policy) {
+        for (int i = 0; i < NUM_REQ_CLASSES; i++) {
+            class_queues[i] = (request_entry_t *)malloc(sizeof(request_entry_t) * buffer_slots_global);
+            if (class_queues[i] == NULL) {
+                perror("No se pudo asignar las colas por clase");
+                return -1;
+            }
+            class_count[i] = 0;
+            class_in_idx[i] = 0;
+            class_out_idx[i] = 0;
+            class_active[i] = 0;
+            class_deficit[i] = 0;
+        }
+        class_rr_current = REQ_CLASS_STATIC;
+        class_weight[REQ_CLASS_STATIC] = weight_static;
+        class_weight[REQ_CLASS_DYNAMIC] = weight_dynamic;
+
+        // Por defecto se reserva al menos un hilo para el contenido estático.
+        if (max_dynamic_workers == 0) {
+            max_dynamic_workers = num_threads > 1 ? num_threads - 1 : 1;
+        }
+        class_max_workers[REQ_CLASS_STATIC] = num_threads;
+        class_max_workers[REQ_CLASS_DYNAMIC] = max_dynamic_workers;
+    }
+
+    pthread_mutex_init(&buffer_mutex_global, NULL);
+    pthread_cond_init(&buffer_not_full_cond, NULL);
+    pthread_cond_init(&buffer_not_empty_cond, NULL);
+    return 0;
+}
+
+/**
+ * @brief Libera el búfer de peticiones y sus primitivas de sincronización.
+ */
+void sched_destroy(void) {
+    free(requests_buffer);
+    requests_buffer = NULL;
+    for (int i = 0; i < NUM_REQ_CLASSES; i++) {
+        free(class_queues[i]);
+        class_queues[i] = NULL;
+    }
+    free(sched_alg_global);
+    sched_alg_global = NULL;
+    pthread_mutex_destroy(&buffer_mutex_global);
+    pthread_cond_destroy(&buffer_not_full_cond);
+    pthread_cond_destroy(&buffer_not_empty_cond);
+}
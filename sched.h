@@ -0,0 +1,74 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "http2.h"
+#include "trace.h"
+
+// --- Búfer de peticiones y políticas de planificación ---
+// El maestro (y las sesiones HTTP/2) insertan peticiones y los trabajadores
+// las extraen según la política elegida con -s. Todo el estado se protege
+// con buffer_mutex_global.
+
+typedef struct {
+    int conn_fd; // Descriptor de archivo para la conexión del cliente.
+    off_t file_size_for_sff; // Tamaño del archivo solicitado (solo para SFF).
+    int req_class; // Clase de la petición (solo para CLASS).
+    int is_tls; // 1 si la conexión llegó por el puerto HTTPS.
+    h2_stream_t *h2_stream; // Stream HTTP/2 a procesar, o NULL para una conexión.
+    trace_record_t *trace; // Registro de trazado, o NULL si no entra en la muestra.
+    uint64_t cost_key; // Clave de la URI en el modelo de coste (solo para SEJF), o 0.
+    int cost_dynamic; // 1 si la URI es de un CGI (solo para SEJF).
+    double expected_cost; // Tiempo de servicio previsto en microsegundos (solo para SEJF).
+    uint64_t prefetch_id; // Precarga del archivo solicitado (con -A), o 0.
+} request_entry_t;
+
+#define NUM_REQ_CLASSES (2)
+#define REQ_CLASS_STATIC (0)
+#define REQ_CLASS_DYNAMIC (1)
+
+// Qué necesita saber una política de cada petición antes de encolarla; el
+// maestro lo obtiene inspeccionando la línea de petición con MSG_PEEK.
+#define SCHED_PEEK_NONE (0)
+#define SCHED_PEEK_SIZE (1) // Tamaño de la respuesta en file_size_for_sff.
+#define SCHED_PEEK_CLASS (2) // Clase en req_class.
+#define SCHED_PEEK_COST (3) // Coste previsto en expected_cost.
+
+// Una política de planificación. Todas sus funciones se llaman con
+// buffer_mutex_global adquirido. El servidor y el simulador (wsim) usan
+// exactamente estas implementaciones.
+typedef struct {
+    const char *name; // Nombre para -s.
+    int peek; // SCHED_PEEK_*.
+    int (*available)(void); // 1 si hay una petición elegible.
+    void (*dequeue)(request_entry_t *entry); // Extrae la siguiente petición.
+    int (*enqueue)(const request_entry_t *entry); // Inserta y devuelve la posición.
+    int (*release)(const request_entry_t *entry); // Fin de servicio, o NULL.
+} sched_policy_t;
+
+extern const sched_policy_t *sched_policies[];
+extern const sched_policy_t *sched_policy;
+
+extern request_entry_t *requests_buffer;
+extern int buffer_slots_global;
+extern char *sched_alg_global;
+extern volatile int buffer_count_global;
+extern int buffer_in_idx;
+extern int buffer_out_idx;
+
+extern pthread_mutex_t buffer_mutex_global;
+extern pthread_cond_t buffer_not_full_cond;
+extern pthread_cond_t buffer_not_empty_cond;
+
+int sched_init(const char *sched_alg, int slots, int num_threads, int weight_static, int weight_dynamic,
+               int max_dynamic_workers);
+void sched_destroy(void);
+const sched_policy_t *sched_policy_find(const char *name);
+int requests_available_locked(void);
+void dequeue_request_locked(request_entry_t *entry);
+int enqueue_request_locked(const request_entry_t *entry);
+int release_request_locked(const request_entry_t *entry);
+
+#endif // __SCHED_H__
@@ -0,0 +1,94 @@
+#include "plugin.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+// Serializa las escrituras de los hilos trabajadores en log_post.txt.
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Estado privado de cada hilo trabajador, creado por spin_thread_init().
+typedef struct {
+    unsigned long requests; // Peticiones atendidas por este hilo.
+} spin_thread_t;
+
+/**
+ * @brief Obtiene el tiempo actual del sistema con precisión de microsegundos.
+ */
+static double get_seconds(void) {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (double)t.tv_sec + (double)t.tv_usec / 1e6;
+}
+
+/**
+ * @brief Reserva el contador de peticiones del hilo que llama.
+ */
+static void *spin_thread_init(void) {
+    return calloc(1, sizeof(spin_thread_t));
+}
+
+/**
+ * @brief Versión en plugin de spin.cgi.
+ * * Espera los segundos indicados en la query string, guarda los datos del
+ * POST en log_post.txt y responde con una página que informa de ello, igual
+ * que el CGI pero dentro del hilo trabajador.
+ */
+static int spin_handle(const plugin_request_t *req, plugin_response_t *resp) {
+    spin_thread_t *self = req->thread_data;
+    int spin_for = atoi(req->query);
+
+    double t1 = get_seconds();
+    while ((get_seconds() - t1) < spin_for)
+        sleep(1);
+    double t2 = get_seconds();
+
+    pthread_mutex_lock(&log_mutex);
+    FILE *log_file = fopen("log_post.txt", "a");
+    if (log_file != NULL) {
+        time_t now = time(NULL);
+        fprintf(log_file, "Fecha: %s", ctime(&now));
+        if (req->body_length > 0) {
+            fprintf(log_file, "Datos: %.*s\n", (int)req->body_length, req->body);
+        } else {
+            fprintf(log_file, "Datos: No se recibieron datos por POST.\n");
+        }
+        fprintf(log_file, "--------------------------------\n");
+        fclose(log_file);
+    }
+    pthread_mutex_unlock(&log_mutex);
+
+    if (self != NULL) {
+        self->requests++;
+    }
+
+    plugin_add_header(resp, "Content-Type", "text/html");
+    plugin_printf(resp, "<h2>Peticion procesada!</h2>\r\n");
+    plugin_printf(resp, "<p>He esperado %.2f segundos.</p>\r\n", t2 - t1);
+    plugin_printf(resp, "<p style='color:green;'><b>¡Datos guardados exitosamente en 'log_post.txt'!</b></p>\r\n");
+    plugin_printf(resp, "<p>Peticiones atendidas por este hilo: %lu</p>\r\n", self ? self->requests : 0);
+    plugin_printf(resp, "<hr><h3>Datos recibidos por POST:</h3><pre>");
+    if (req->body_length > 0) {
+        plugin_write(resp, req->body, req->body_length);
+    } else {
+        plugin_printf(resp, "No se recibieron datos por POST.");
+    }
+    plugin_printf(resp, "</pre>\r\n");
+    return 0;
+}
+
+static const plugin_route_t spin_routes[] = {
+    { "/plugins/spin", spin_handle },
+    { NULL, NULL },
+};
+
+const plugin_t wserver_plugin = {
+    .api_version = PLUGIN_API_VERSION,
+    .name = "spin",
+    .routes = spin_routes,
+    .init = NULL,
+    .thread_init = spin_thread_init,
+};
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Prueba del proxy inverso (-x) contra el servidor de origen de prueba wupstream.
+# Uso: ./test_proxy.sh  (requiere "make wserver wupstream" y curl)
+
+PORT=${PORT:-18080}
+UPSTREAM_PORT=${UPSTREAM_PORT:-18081}
+CLOSED_PORT=${CLOSED_PORT:-18082} # Puerto sin servidor, para el 502.
+BASE="http://localhost:$PORT"
+FAILURES=0
+
+./wupstream "$UPSTREAM_PORT" > /dev/null 2>&1 &
+UPSTREAM_PID=$!
+# Un solo trabajador, para que las peticiones seguidas compartan la conexión
+# del pool.
+./wserver -d web_files -p "$PORT" -t 1 -b 4 \
+    -x /api=127.0.0.1:"$UPSTREAM_PORT" -x /down=127.0.0.1:"$CLOSED_PORT" -X 500 > /dev/null 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID $UPSTREAM_PID 2> /dev/null; wait 2> /dev/null' EXIT
+sleep 0.5
+
+# check <descripción> <esperado> <obtenido>
+check() {
+    if [ "$2" == "$3" ]; then
+        echo "OK     $1"
+    else
+        echo "FALLO  $1: se esperaba '$2' y se obtuvo '$3'"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+first=$(curl -s "$BASE/api/uno")
+second=$(curl -s "$BASE/api/dos")
+check "GET reenviado" "GET /api/uno body=" "${first#* req=* }"
+check "conexión reutilizada" "${first%% *} req=2" "$(echo "$second" | cut -d' ' -f1,2)"
+
+post=$(curl -s -d "hola=mundo" "$BASE/api/post")
+check "POST con Content-Length" "POST /api/post body=hola=mundo" "${post#* req=* }"
+
+chunked=$(printf 'trozo1trozo2' | curl -s -H "Transfer-Encoding: chunked" --data-binary @- "$BASE/api/chunked")
+check "POST chunked" "POST /api/chunked body=trozo1trozo2" "${chunked#* req=* }"
+
+check "502 con el origen caído" "502" "$(curl -s -o /dev/null -w '%{http_code}' "$BASE/down/x")"
+check "504 con el origen lento" "504" "$(curl -s -o /dev/null -w '%{http_code}' "$BASE/api/slow")"
+smuggle=$(curl -s -o /dev/null -w '%{http_code}' -H "Transfer-Encoding: chunked" -H "Content-Length: 5" \
+    --data-binary "x" "$BASE/api/smuggle")
+check "400 con Content-Length y chunked" "400" "$smuggle"
+
+if [ "$FAILURES" -ne 0 ]; then
+    echo "$FAILURES pruebas fallidas"
+    exit 1
+fi
+echo "Todas las pruebas del proxy pasaron"
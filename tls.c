@@ -0,0 +1,217 @@
+#include "io_helper.h"
+#include "tls.h"
+#include <pthread.h>
+#include <poll.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#define TLS_RELAY_BUF (16384)
+#define TLS_HANDSHAKE_TIMEOUT (10) // Segundos máximos para el handshake.
+
+// Contexto TLS compartido por todas las conexiones HTTPS. Guarda el
+// certificado, la configuración de kTLS y las claves de los tickets de sesión.
+static SSL_CTX *tls_ctx_global;
+
+// Estado de un relevo en espacio de usuario, usado cuando el kernel no pudo
+// asumir el cifrado de la conexión (kTLS no disponible).
+typedef struct {
+    SSL *ssl; // Sesión TLS con el cliente.
+    int net_fd; // Socket cifrado con el cliente.
+    int app_fd; // Extremo en claro que lee y escribe el trabajador.
+} tls_relay_t;
+
+/**
+ * @brief Escribe un búfer completo en un socket, reintentando escrituras parciales.
+ *
+ * @return 0 en caso de éxito, -1 si la otra parte cerró la conexión.
+ */
+static int tls_send_all(int fd, const char *buf, int len) {
+    while (len > 0) {
+        ssize_t rc = send(fd, buf, len, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rutina del hilo de relevo para conexiones sin kTLS.
+ * * Descifra lo que envía el cliente y lo entrega al extremo en claro del
+ * trabajador, y cifra todo lo que el trabajador (o un CGI) escribe en ese
+ * extremo. Termina cuando el trabajador cierra su extremo o el cliente se
+ * desconecta.
+ *
+ * @param arg Un puntero a tls_relay_t; el hilo libera todos sus recursos.
+ * @return NULL.
+ */
+static void *tls_relay_routine(void *arg) {
+    tls_relay_t *relay = (tls_relay_t *)arg;
+    char buf[TLS_RELAY_BUF];
+    struct pollfd pfds[2];
+
+    pfds[0].fd = relay->net_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = relay->app_fd;
+    pfds[1].events = POLLIN;
+
+    while (1) {
+        // OpenSSL puede tener registros ya descifrados que poll() no ve.
+        if (pfds[0].fd >= 0 && SSL_pending(relay->ssl) > 0) {
+            pfds[0].revents = POLLIN;
+            pfds[1].revents = 0;
+        } else if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (pfds[0].revents) {
+            int n = SSL_read(relay->ssl, buf, sizeof(buf));
+            if (n <= 0) {
+                // El cliente terminó de enviar: el trabajador verá EOF.
+                shutdown(relay->app_fd, SHUT_WR);
+                pfds[0].fd = -1;
+            } else if (tls_send_all(relay->app_fd, buf, n) < 0) {
+                break;
+            }
+        }
+
+        if (pfds[1].revents) {
+            ssize_t n = read(relay->app_fd, buf, sizeof(buf));
+            if (n <= 0) {
+                break;
+            }
+            if (SSL_write(relay->ssl, buf, (int)n) <= 0) {
+                break;
+            }
+        }
+    }
+
+    SSL_shutdown(relay->ssl);
+    SSL_free(relay->ssl);
+    close(relay->net_fd);
+    close(relay->app_fd);
+    free(relay);
+    return NULL;
+}
+
+/**
+ * @brief Crea el contexto TLS del servidor a partir de un certificado y su clave.
+ * * Limita la negociación a TLS 1.2 con AES-GCM, que es la combinación que
+ * OpenSSL 3.0 puede delegar al kernel (kTLS) en ambos sentidos, y activa
+ * SSL_OP_ENABLE_KTLS. La reanudación de sesiones por tickets queda activa
+ * para evitar handshakes completos en las reconexiones.
+ *
+ * @param cert_file Ruta del certificado en formato PEM.
+ * @param key_file Ruta de la clave privada en formato PEM.
+ * @return 0 en caso de éxito, -1 en caso de error.
+ */
+int tls_init(const char *cert_file, const char *key_file) {
+    tls_ctx_global = SSL_CTX_new(TLS_server_method());
+    if (tls_ctx_global == NULL) {
+        ERR_print_errors_fp(stderr);
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(tls_ctx_global, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(tls_ctx_global, TLS1_2_VERSION);
+    SSL_CTX_set_cipher_list(tls_ctx_global,
+                            "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                            "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384");
+    SSL_CTX_set_options(tls_ctx_global, SSL_OP_ENABLE_KTLS);
+
+    SSL_CTX_set_session_cache_mode(tls_ctx_global, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(tls_ctx_global, (const unsigned char *)"wserver", 7);
+
+    if (SSL_CTX_use_certificate_chain_file(tls_ctx_global, cert_file) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(tls_ctx_global, key_file, SSL_FILETYPE_PEM) <= 0 ||
+        !SSL_CTX_check_private_key(tls_ctx_global)) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(tls_ctx_global);
+        tls_ctx_global = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Realiza el handshake TLS y devuelve un descriptor en claro para la petición.
+ * * Si OpenSSL logró activar kTLS para envío y recepción, el cifrado lo hace
+ * el kernel y se devuelve el mismo socket, de modo que read(), write(), mmap
+ * y los CGI funcionan sin copias adicionales. Si no, se crea un par de
+ * sockets y un hilo de relevo cifra y descifra en espacio de usuario.
+ *
+ * @param fd El socket aceptado en el puerto HTTPS. La función toma su
+ * propiedad y lo cierra si el handshake falla.
+ * @return El descriptor que debe usar el trabajador, o -1 en caso de error.
+ */
+int tls_accept(int fd) {
+    SSL *ssl = SSL_new(tls_ctx_global);
+    if (ssl == NULL) {
+        close_or_die(fd);
+        return -1;
+    }
+    SSL_set_fd(ssl, fd);
+
+    // Un cliente lento no debe retener al trabajador durante el handshake.
+    struct timeval tv = { TLS_HANDSHAKE_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (SSL_accept(ssl) <= 0) {
+        fprintf(stderr, "[TLS FD=%d] Falló el handshake\n", fd);
+        SSL_free(ssl);
+        close_or_die(fd);
+        return -1;
+    }
+
+    tv.tv_sec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl)) && BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+        // El kernel ya tiene las claves; la sesión en espacio de usuario
+        // no se necesita más (SSL_set_fd no cierra el socket al liberarla).
+        printf("[TLS FD=%d] Handshake completo (%s), kTLS activo\n", fd,
+               SSL_session_reused(ssl) ? "reanudado" : "completo");
+        SSL_free(ssl);
+        return fd;
+    }
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        perror("socketpair");
+        SSL_free(ssl);
+        close_or_die(fd);
+        return -1;
+    }
+
+    tls_relay_t *relay = (tls_relay_t *)malloc(sizeof(tls_relay_t));
+    assert(relay != NULL);
+    relay->ssl = ssl;
+    relay->net_fd = fd;
+    relay->app_fd = pair[1];
+
+    printf("[TLS FD=%d] Handshake completo (%s), kTLS no disponible: relevo en espacio de usuario\n",
+           fd, SSL_session_reused(ssl) ? "reanudado" : "completo");
+
+    pthread_t relay_thread;
+    if (pthread_create(&relay_thread, NULL, tls_relay_routine, relay) != 0) {
+        perror("No se pudo crear el hilo de relevo TLS");
+        SSL_free(ssl);
+        close_or_die(fd);
+        close_or_die(pair[0]);
+        close_or_die(pair[1]);
+        free(relay);
+        return -1;
+    }
+    pthread_detach(relay_thread);
+    return pair[0];
+}
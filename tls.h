@@ -0,0 +1,7 @@
+#ifndef __TLS_H__
+#define __TLS_H__
+
+int tls_init(const char *cert_file, const char *key_file);
+int tls_accept(int fd);
+
+#endif // __TLS_H__
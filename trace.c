@@ -0,0 +1,209 @@
+#include "io_helper.h"
+#include "trace.h"
+#include <pthread.h>
+#include <time.h>
+
+#define TRACE_THREAD_RECORDS (64) // Registros por búfer de hilo.
+#define TRACE_FLUSH_NS (1000000000ULL) // Antigüedad máxima de un búfer sin volcar.
+
+// Cada hilo acumula sus registros terminados y los vuelca al archivo en
+// bloque, de modo que el trazado no añade una escritura por petición ni
+// contención entre trabajadores.
+typedef struct {
+    trace_record_t records[TRACE_THREAD_RECORDS];
+    int count;
+    uint64_t oldest_ns; // Momento en que se añadió el primer registro pendiente.
+} trace_thread_buf_t;
+
+static int trace_fd = -1; // Archivo de trazas (-1 = trazado desactivado).
+static int sample_every_global; // Se traza 1 de cada N conexiones.
+static uint64_t next_id; // Solo lo usa el hilo maestro.
+static pthread_mutex_t trace_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread trace_thread_buf_t *thread_buf; // Búfer del hilo actual.
+static __thread trace_record_t *current_rec; // Petición que atiende el hilo actual.
+
+/**
+ * @brief Lee el reloj monotónico en nanosegundos.
+ */
+static uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Escribe en el archivo los registros pendientes del hilo actual.
+ * * Los trabajadores la llaman antes de quedarse esperando, para que sus
+ * registros no se queden en memoria mientras el servidor está ocioso.
+ */
+void trace_flush(void) {
+    if (thread_buf == NULL || thread_buf->count == 0) {
+        return;
+    }
+    size_t len = sizeof(trace_record_t) * thread_buf->count;
+    pthread_mutex_lock(&trace_file_mutex);
+    if (write(trace_fd, thread_buf->records, len) != (ssize_t)len) {
+        perror("write(trace)");
+    }
+    pthread_mutex_unlock(&trace_file_mutex);
+    thread_buf->count = 0;
+}
+
+/**
+ * @brief Activa el trazado de peticiones.
+ *
+ * @param path El archivo binario donde se escriben los registros.
+ * @param sample_every Se traza una de cada sample_every conexiones.
+ * @param keep 1 para seguir escribiendo a continuación de un archivo que ya
+ * tiene cabecera (el proceso que sustituye al servidor en una recarga), 0
+ * para truncarlo.
+ * @return 0 en caso de éxito, -1 si no se pudo crear el archivo.
+ */
+int trace_init(const char *path, int sample_every, int keep) {
+    trace_file_header_t hdr;
+    struct stat sbuf;
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | (keep ? 0 : O_TRUNC) | O_APPEND, 0644);
+    if (trace_fd < 0) {
+        perror(path);
+        return -1;
+    }
+    // El proceso anterior escribe en el mismo archivo mientras termina; con
+    // O_APPEND cada bloque de registros queda entero.
+    if (keep && fstat(trace_fd, &sbuf) == 0 && sbuf.st_size >= (off_t)sizeof(hdr)) {
+        sample_every_global = sample_every > 0 ? sample_every : 1;
+        printf("Trazando 1 de cada %d conexiones en %s (continuación)\n", sample_every_global, path);
+        return 0;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.num_stages = TRACE_NUM_STAGES;
+    hdr.record_size = sizeof(trace_record_t);
+    if (write(trace_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        perror(path);
+        close_or_die(trace_fd);
+        trace_fd = -1;
+        return -1;
+    }
+    sample_every_global = sample_every > 0 ? sample_every : 1;
+    printf("Trazando 1 de cada %d conexiones en %s\n", sample_every_global, path);
+    return 0;
+}
+
+/**
+ * @brief Decide si se traza una conexión recién aceptada.
+ * * Solo debe llamarla el hilo maestro, justo después de accept().
+ *
+ * @return Un registro con la etapa TRACE_ACCEPT marcada, o NULL si el
+ * trazado está desactivado o la conexión no entra en la muestra.
+ */
+trace_record_t *trace_begin(void) {
+    if (trace_fd < 0) {
+        return NULL;
+    }
+    uint64_t id = next_id++;
+    if (id % sample_every_global != 0) {
+        return NULL;
+    }
+    trace_record_t *rec = (trace_record_t *)calloc(1, sizeof(trace_record_t));
+    assert(rec != NULL);
+    rec->id = id;
+    rec->ts[TRACE_ACCEPT] = trace_now_ns();
+    return rec;
+}
+
+/**
+ * @brief Marca la primera vez que un registro alcanza una etapa.
+ *
+ * @param rec El registro, o NULL si la petición no se traza.
+ * @param stage Una de las etapas TRACE_*.
+ */
+void trace_stamp(trace_record_t *rec, int stage) {
+    if (rec != NULL && rec->ts[stage] == 0) {
+        rec->ts[stage] = trace_now_ns();
+    }
+}
+
+/**
+ * @brief Termina un registro y lo pasa al búfer del hilo actual.
+ * * El búfer se vuelca al archivo cuando se llena o cuando su registro más
+ * antiguo lleva más de un segundo esperando.
+ *
+ * @param rec El registro, o NULL. Se libera.
+ */
+void trace_end(trace_record_t *rec) {
+    if (rec == NULL) {
+        return;
+    }
+    if (thread_buf == NULL) {
+        thread_buf = (trace_thread_buf_t *)calloc(1, sizeof(trace_thread_buf_t));
+        assert(thread_buf != NULL);
+    }
+
+    uint64_t now = trace_now_ns();
+    if (thread_buf->count == 0) {
+        thread_buf->oldest_ns = now;
+    }
+    thread_buf->records[thread_buf->count++] = *rec;
+    free(rec);
+
+    if (thread_buf->count == TRACE_THREAD_RECORDS || now - thread_buf->oldest_ns >= TRACE_FLUSH_NS) {
+        trace_flush();
+    }
+}
+
+/**
+ * @brief Asocia un registro a la petición que atiende el hilo actual.
+ * * Las funciones de request.c marcan sus etapas con trace_mark() sin
+ * necesidad de recibir el registro como parámetro.
+ */
+void trace_set_current(trace_record_t *rec) {
+    current_rec = rec;
+}
+
+/**
+ * @brief Retira el registro del hilo actual para entregárselo a otro dueño
+ * (por ejemplo, una transmisión por partes).
+ *
+ * @return El registro, o NULL si la petición no se traza.
+ */
+trace_record_t *trace_take_current(void) {
+    trace_record_t *rec = current_rec;
+    current_rec = NULL;
+    return rec;
+}
+
+/**
+ * @brief Marca una etapa en el registro del hilo actual.
+ */
+void trace_mark(int stage) {
+    trace_stamp(current_rec, stage);
+}
+
+/**
+ * @brief Añade banderas TRACE_F_* al registro del hilo actual.
+ */
+void trace_set_flags(uint32_t flags) {
+    if (current_rec != NULL) {
+        current_rec->flags |= flags;
+    }
+}
+
+/**
+ * @brief Guarda el tamaño del cuerpo de la respuesta en el registro actual.
+ */
+void trace_set_bytes(uint64_t bytes) {
+    if (current_rec != NULL) {
+        current_rec->bytes = bytes;
+    }
+}
+
+/**
+ * @brief Guarda el trabajador que atiende la petición en el registro actual.
+ */
+void trace_set_worker(uint32_t worker) {
+    if (current_rec != NULL) {
+        current_rec->worker = worker;
+    }
+}
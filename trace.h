@@ -0,0 +1,58 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+// Etapas del ciclo de vida de una petición, en el orden en que ocurren.
+// Una etapa que la petición no atraviesa (por ejemplo, el peek en FIFO)
+// queda con marca de tiempo 0.
+enum {
+    TRACE_ACCEPT, // accept() devolvió la conexión.
+    TRACE_PEEK, // El maestro terminó de inspeccionar la petición (SFF/CLASS).
+    TRACE_ENQUEUE, // La petición entró al búfer (tras esperar si estaba lleno).
+    TRACE_DEQUEUE, // Un trabajador la sacó del búfer.
+    TRACE_HEADERS, // Línea de petición y cabeceras leídas.
+    TRACE_STAT, // Archivo resuelto (stat() o índice del paquete).
+    TRACE_FIRST_BYTE, // Cabeceras de la respuesta escritas.
+    TRACE_LAST_BYTE, // Último byte del cuerpo escrito.
+    TRACE_CLOSE, // Conexión cerrada.
+    TRACE_NUM_STAGES
+};
+
+// Banderas de un registro.
+#define TRACE_F_TLS (1u << 0) // Llegó por el puerto HTTPS.
+#define TRACE_F_DYNAMIC (1u << 1) // Petición a un CGI.
+#define TRACE_F_CHUNKED (1u << 2) // El cuerpo se envió por turnos.
+#define TRACE_F_HANDOFF (1u << 3) // La conexión pasó a otro motor (HTTP/2).
+
+// Formato del archivo: una cabecera seguida de registros de tamaño fijo.
+#define TRACE_MAGIC "WTRACE01"
+
+typedef struct {
+    char magic[8]; // TRACE_MAGIC, sin '\0'.
+    uint32_t num_stages; // TRACE_NUM_STAGES del servidor que lo escribió.
+    uint32_t record_size; // sizeof(trace_record_t).
+} trace_file_header_t;
+
+typedef struct {
+    uint64_t id; // Número de conexión asignado por el maestro.
+    uint64_t ts[TRACE_NUM_STAGES]; // Nanosegundos de CLOCK_MONOTONIC (0 = no ocurrió).
+    uint64_t bytes; // Bytes del cuerpo de la respuesta, si se conocen.
+    uint32_t flags; // TRACE_F_*.
+    uint32_t worker; // Hilo trabajador que la atendió.
+} trace_record_t;
+
+int trace_init(const char *path, int sample_every, int keep);
+trace_record_t *trace_begin(void);
+void trace_stamp(trace_record_t *rec, int stage);
+void trace_end(trace_record_t *rec);
+void trace_flush(void);
+
+void trace_set_current(trace_record_t *rec);
+trace_record_t *trace_take_current(void);
+void trace_mark(int stage);
+void trace_set_flags(uint32_t flags);
+void trace_set_bytes(uint64_t bytes);
+void trace_set_worker(uint32_t worker);
+
+#endif // __TRACE_H__
@@ -0,0 +1,323 @@
+#include "io_helper.h"
+#include "transfer.h"
+#include <pthread.h>
+#include <poll.h>
+
+// --- Estado del motor de transmisiones ---
+// Las transmisiones que no pueden avanzar (socket lleno o límite de ancho de
+// banda alcanzado) se "estacionan" en una lista vigilada por un hilo con
+// poll(). Cuando vuelven a poder enviar, se devuelven a los trabajadores a
+// través de la función on_ready proporcionada por el servidor.
+static size_t chunk_size_global; // Bytes enviados por turno (0 = desactivado).
+static size_t rate_limit_global; // Bytes por segundo por conexión (0 = sin límite).
+static void (*on_ready_global)(transfer_t *); // Devuelve una transmisión a la cola.
+
+static transfer_t *parked_head; // Transmisiones estacionadas.
+static int parked_count; // Número de transmisiones estacionadas.
+static pthread_mutex_t parked_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int wake_pipe[2]; // Despierta al hilo de poll() cuando cambia la lista.
+static int active_transfers; // Transmisiones sin terminar (atómico).
+
+#define TRANSFER_IDLE_TIMEOUT_MS (15000) // Espera máxima a un cliente que no lee.
+
+/**
+ * @brief Diferencia en milisegundos entre dos instantes (b - a).
+ */
+static long timespec_diff_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1000L + (b->tv_nsec - a->tv_nsec) / 1000000L;
+}
+
+/**
+ * @brief Cierra la conexión y libera los recursos de una transmisión.
+ */
+static void transfer_finish(transfer_t *t) {
+    if (t->unmap) {
+        munmap_or_die(t->data, t->size);
+    }
+    trace_stamp(t->trace, TRACE_LAST_BYTE);
+    close_or_die(t->conn_fd);
+    trace_stamp(t->trace, TRACE_CLOSE);
+    trace_end(t->trace);
+    free(t);
+    __atomic_fetch_sub(&active_transfers, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Añade una transmisión a la lista de espera del hilo de poll().
+ */
+static void transfer_park(transfer_t *t) {
+    char c = 0;
+
+    pthread_mutex_lock(&parked_mutex);
+    t->next = parked_head;
+    parked_head = t;
+    parked_count++;
+    pthread_mutex_unlock(&parked_mutex);
+
+    // Si la tubería está llena el hilo ya tiene un aviso pendiente.
+    if (write(wake_pipe[1], &c, 1) < 0 && errno != EAGAIN) {
+        perror("write(wake_pipe)");
+    }
+}
+
+/**
+ * @brief Rutina del hilo que vigila las transmisiones estacionadas.
+ * * Espera con poll() a que los sockets bloqueados acepten datos o a que
+ * venza el plazo de las transmisiones limitadas por ancho de banda, y las
+ * entrega de nuevo a los trabajadores. Un cliente que deja de leer durante
+ * TRANSFER_IDLE_TIMEOUT_MS pierde la conexión; si no, retendría el archivo
+ * mapeado para siempre y el apagado ordenado nunca terminaría.
+ *
+ * @param arg No se utiliza.
+ * @return NULL.
+ */
+static void *transfer_poller_routine(void *arg) {
+    (void)arg;
+    struct pollfd *pfds = NULL;
+    transfer_t **snapshot = NULL;
+    int capacity = 0;
+
+    while (1) {
+        struct timespec now;
+        int n = 0;
+        int timeout_ms = -1;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        // Copia la lista; solo este hilo retira elementos, así que los
+        // punteros siguen siendo válidos después de soltar el mutex.
+        pthread_mutex_lock(&parked_mutex);
+        if (parked_count + 1 > capacity) {
+            capacity = (parked_count + 1) * 2;
+            pfds = realloc(pfds, sizeof(struct pollfd) * capacity);
+            snapshot = realloc(snapshot, sizeof(transfer_t *) * capacity);
+            assert(pfds != NULL && snapshot != NULL);
+        }
+        pfds[n].fd = wake_pipe[0];
+        pfds[n].events = POLLIN;
+        snapshot[n] = NULL;
+        n++;
+        for (transfer_t *t = parked_head; t != NULL; t = t->next) {
+            pfds[n].fd = t->wait_writable ? t->conn_fd : -1;
+            pfds[n].events = POLLOUT;
+            pfds[n].revents = 0;
+            snapshot[n] = t;
+            long ms = timespec_diff_ms(&now, t->wait_writable ? &t->idle_deadline : &t->wake_at);
+            if (ms < 0) {
+                ms = 0;
+            }
+            if (timeout_ms < 0 || ms < timeout_ms) {
+                timeout_ms = (int)ms;
+            }
+            n++;
+        }
+        pthread_mutex_unlock(&parked_mutex);
+
+        if (poll(pfds, n, timeout_ms) < 0 && errno != EINTR) {
+            perror("poll");
+            continue;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        // Retira de la lista las transmisiones que ya pueden continuar y las
+        // de los clientes que llevan demasiado tiempo sin leer.
+        transfer_t *ready = NULL, *expired = NULL;
+        pthread_mutex_lock(&parked_mutex);
+        for (int i = 1; i < n; i++) {
+            transfer_t *t = snapshot[i];
+            int can_run = t->wait_writable ? (pfds[i].revents != 0)
+                                           : (timespec_diff_ms(&now, &t->wake_at) <= 0);
+            int idle = t->wait_writable && !can_run && timespec_diff_ms(&now, &t->idle_deadline) <= 0;
+            if (!can_run && !idle) {
+                continue;
+            }
+            transfer_t **pp = &parked_head;
+            while (*pp != t) {
+                pp = &(*pp)->next;
+            }
+            *pp = t->next;
+            parked_count--;
+            if (idle) {
+                t->next = expired;
+                expired = t;
+            } else {
+                t->next = ready;
+                ready = t;
+            }
+        }
+        pthread_mutex_unlock(&parked_mutex);
+
+        while (expired != NULL) {
+            transfer_t *t = expired;
+            expired = expired->next;
+            printf("[TRANSFER FD=%d] El cliente no lee desde hace %d ms; se cierra la conexión.\n", t->conn_fd,
+                   TRANSFER_IDLE_TIMEOUT_MS);
+            transfer_finish(t);
+        }
+
+        while (ready != NULL) {
+            transfer_t *t = ready;
+            ready = ready->next;
+            t->next = NULL;
+            on_ready_global(t);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Configura el motor de transmisiones y arranca su hilo de poll().
+ *
+ * @param chunk_size Bytes que una transmisión envía por turno. Los archivos
+ * de este tamaño o menores se siguen enviando de una vez. 0 lo desactiva.
+ * @param rate_limit Máximo de bytes por segundo por conexión (0 = sin límite).
+ * @param on_ready Función que devuelve una transmisión lista a los trabajadores.
+ */
+void transfer_init(size_t chunk_size, size_t rate_limit, void (*on_ready)(transfer_t *)) {
+    chunk_size_global = chunk_size;
+    rate_limit_global = rate_limit;
+    on_ready_global = on_ready;
+
+    if (chunk_size_global == 0) {
+        return;
+    }
+
+    pipe_or_die(wake_pipe);
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    pthread_t poller;
+    if (pthread_create(&poller, NULL, transfer_poller_routine, NULL) != 0) {
+        perror("No se pudo crear el hilo de las transmisiones");
+        chunk_size_global = 0;
+        return;
+    }
+    pthread_detach(poller);
+}
+
+/**
+ * @brief Indica si un archivo debe enviarse por partes.
+ *
+ * @param filesize El tamaño del archivo.
+ * @return 1 si el archivo supera el tamaño de turno configurado, 0 si no.
+ */
+int transfer_enabled(size_t filesize) {
+    return chunk_size_global > 0 && (filesize > chunk_size_global || rate_limit_global > 0);
+}
+
+/**
+ * @brief Devuelve el número de transmisiones que aún no han terminado,
+ * estén en la cola, estacionadas o en manos de un trabajador.
+ */
+int transfer_active(void) {
+    return __atomic_load_n(&active_transfers, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Envía como máximo un turno de datos de una transmisión.
+ * * Tras el envío la transmisión termina (cerrando la conexión), se estaciona
+ * si el socket está lleno o si superó su ancho de banda, o se devuelve a la
+ * cola de trabajadores para que las demás peticiones tengan su turno.
+ *
+ * @param t La transmisión a continuar.
+ */
+void transfer_run(transfer_t *t) {
+    size_t budget = chunk_size_global;
+
+    if (rate_limit_global > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - t->started.tv_sec) + (now.tv_nsec - t->started.tv_nsec) / 1e9;
+        double allowed = elapsed * rate_limit_global + chunk_size_global;
+        if ((double)t->offset >= allowed) {
+            // Espera hasta que el límite permita enviar un turno completo.
+            double resume = (double)t->offset / rate_limit_global;
+            t->wake_at = t->started;
+            t->wake_at.tv_sec += (time_t)resume;
+            t->wake_at.tv_nsec += (long)((resume - (time_t)resume) * 1e9);
+            if (t->wake_at.tv_nsec >= 1000000000L) {
+                t->wake_at.tv_sec++;
+                t->wake_at.tv_nsec -= 1000000000L;
+            }
+            t->wait_writable = 0;
+            transfer_park(t);
+            return;
+        }
+        if (allowed - t->offset < budget) {
+            budget = (size_t)(allowed - t->offset);
+        }
+    }
+
+    while (budget > 0 && t->offset < t->size) {
+        size_t len = t->size - t->offset;
+        if (len > budget) {
+            len = budget;
+        }
+        ssize_t rc = send(t->conn_fd, t->data + t->offset, len, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                t->wait_writable = 1;
+                clock_gettime(CLOCK_MONOTONIC, &t->idle_deadline);
+                t->idle_deadline.tv_sec += TRANSFER_IDLE_TIMEOUT_MS / 1000;
+                transfer_park(t);
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            // El cliente se desconectó: se descarta el resto del archivo.
+            transfer_finish(t);
+            return;
+        }
+        t->offset += rc;
+        budget -= rc;
+    }
+
+    if (t->offset >= t->size) {
+        transfer_finish(t);
+        return;
+    }
+    on_ready_global(t);
+}
+
+/**
+ * @brief Inicia la transmisión por partes de un archivo ya mapeado.
+ * * La conexión pasa a modo no bloqueante y queda a cargo del motor de
+ * transmisiones, que la cerrará al terminar. El registro de trazado del
+ * hilo actual, si lo hay, pasa también a la transmisión.
+ *
+ * @param fd El descriptor de archivo de la conexión.
+ * @param data La región mapeada con el contenido del archivo.
+ * @param size El tamaño del archivo.
+ * @param unmap 1 si la región es del archivo y debe liberarse al terminar,
+ * 0 si pertenece al paquete de contenido, que permanece mapeado.
+ */
+void transfer_start(int fd, char *data, size_t size, int unmap) {
+    transfer_t *t = (transfer_t *)malloc(sizeof(transfer_t));
+    assert(t != NULL);
+    __atomic_fetch_add(&active_transfers, 1, __ATOMIC_RELAXED);
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    t->conn_fd = fd;
+    t->data = data;
+    t->size = size;
+    t->unmap = unmap;
+    trace_set_flags(TRACE_F_CHUNKED);
+    t->trace = trace_take_current();
+    t->offset = 0;
+    t->wait_writable = 0;
+    t->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &t->started);
+    t->wake_at = t->started;
+
+    transfer_run(t);
+}
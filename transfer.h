@@ -0,0 +1,30 @@
+#ifndef __TRANSFER_H__
+#define __TRANSFER_H__
+
+#include <stddef.h>
+#include <time.h>
+#include "trace.h"
+
+// Estado de una transmisión grande en curso. El archivo permanece mapeado
+// en memoria hasta que se envía el último byte o el cliente se desconecta.
+typedef struct transfer {
+    int conn_fd; // Conexión del cliente (en modo no bloqueante).
+    char *data; // Región mapeada del archivo.
+    size_t size; // Tamaño total del archivo.
+    size_t offset; // Bytes ya enviados.
+    struct timespec started; // Inicio de la transmisión (límite de ancho de banda).
+    struct timespec wake_at; // Momento en que puede continuar, si está limitada.
+    int wait_writable; // 1 si espera a que el socket acepte más datos.
+    struct timespec idle_deadline; // Si espera al socket, momento en que se abandona.
+    int unmap; // 1 si la región se libera al terminar (0 si es del paquete de contenido).
+    trace_record_t *trace; // Registro de trazado de la petición, o NULL.
+    struct transfer *next; // Enlace para las listas de espera y de listas.
+} transfer_t;
+
+void transfer_init(size_t chunk_size, size_t rate_limit, void (*on_ready)(transfer_t *));
+int transfer_enabled(size_t filesize);
+void transfer_start(int fd, char *data, size_t size, int unmap);
+void transfer_run(transfer_t *t);
+int transfer_active(void);
+
+#endif // __TRANSFER_H__
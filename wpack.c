@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include "io_helper.h"
+#include "pack.h"
+#include "mime.h"
+#include <ftw.h>
+#include <zlib.h>
+
+#define MAXBUF (8192)
+
+// Un archivo leído del directorio, pendiente de escribirse en el paquete.
+typedef struct {
+    char *path; // Ruta con el formato de request_parse_uri() ("./index.html").
+    char mime[MAXBUF];
+    char *data;
+    size_t size;
+    char *gzip; // Variante comprimida, o NULL.
+    size_t gzip_size;
+} wpack_file_t;
+
+static wpack_file_t *files;
+static int file_count, file_capacity;
+static const char *root_dir;
+static int use_gzip;
+
+/**
+ * @brief Lee un archivo completo en memoria.
+ */
+static char *wpack_read_file(const char *path, size_t size) {
+    char *data = malloc(size > 0 ? size : 1);
+    assert(data != NULL);
+    int fd = open_or_die((char *)path, O_RDONLY, 0);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, data + done, size - done);
+        if (n <= 0) {
+            fprintf(stderr, "Error leyendo %s\n", path);
+            exit(1);
+        }
+        done += n;
+    }
+    close_or_die(fd);
+    return data;
+}
+
+/**
+ * @brief Comprime un búfer en formato gzip.
+ *
+ * @return El búfer comprimido (malloc), o NULL si no reduce el tamaño al
+ * menos un 10%, en cuyo caso no merece la pena guardarlo.
+ */
+static char *wpack_gzip(const char *data, size_t size, size_t *out_size) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 16: ventana máxima con cabecera gzip en lugar de zlib.
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t bound = deflateBound(&zs, size);
+    char *out = malloc(bound);
+    assert(out != NULL);
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = size;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = bound;
+    int rc = deflate(&zs, Z_FINISH);
+    *out_size = zs.total_out;
+    deflateEnd(&zs);
+
+    if (rc != Z_STREAM_END || *out_size >= size - size / 10) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * @brief Callback de nftw(): añade cada archivo regular estático a la lista.
+ * * Las rutas que contienen "cgi" se omiten, porque request_parse_uri() las
+ * trata siempre como contenido dinámico y se ejecutan desde el directorio.
+ */
+static int wpack_visit(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    (void)ftwbuf;
+    if (typeflag != FTW_F || !S_ISREG(sb->st_mode)) {
+        return 0;
+    }
+
+    const char *rel = fpath + strlen(root_dir);
+    char path[MAXBUF];
+    snprintf(path, sizeof(path), ".%s%s", rel[0] == '/' ? "" : "/", rel);
+    if (strstr(path, "cgi")) {
+        printf("  omitido (CGI): %s\n", path);
+        return 0;
+    }
+
+    if (file_count == file_capacity) {
+        file_capacity = file_capacity ? file_capacity * 2 : 64;
+        files = realloc(files, sizeof(wpack_file_t) * file_capacity);
+        assert(files != NULL);
+    }
+    wpack_file_t *f = &files[file_count++];
+    f->path = strdup(path);
+    assert(f->path != NULL);
+    mime_get_filetype(f->path, f->mime);
+    f->size = sb->st_size;
+    f->data = wpack_read_file(fpath, f->size);
+    f->gzip = NULL;
+    f->gzip_size = 0;
+
+    int textual = strncmp(f->mime, "text/", 5) == 0 || strcmp(f->mime, "application/javascript") == 0;
+    if (use_gzip && textual && f->size > 0) {
+        f->gzip = wpack_gzip(f->data, f->size, &f->gzip_size);
+    }
+    return 0;
+}
+
+static int wpack_compare(const void *a, const void *b) {
+    return strcmp(((const wpack_file_t *)a)->path, ((const wpack_file_t *)b)->path);
+}
+
+/**
+ * @brief Escribe un bloque en el paquete y devuelve su desplazamiento.
+ * * Los bloques se alinean a 8 bytes para que el índice pueda leerse
+ * directamente desde la región mapeada.
+ */
+static uint64_t wpack_write(FILE *out, const void *data, size_t size) {
+    static const char zeros[8];
+    long pos = ftell(out);
+    if (pos % 8 != 0) {
+        fwrite(zeros, 1, 8 - pos % 8, out);
+        pos += 8 - pos % 8;
+    }
+    if (size > 0 && fwrite(data, 1, size, out) != size) {
+        perror("fwrite");
+        exit(1);
+    }
+    return (uint64_t)pos;
+}
+
+/**
+ * @brief ETag de un contenido: hash FNV-1a de 64 bits entre comillas.
+ */
+static void wpack_etag(const char *data, size_t size, char *etag) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    snprintf(etag, PACK_ETAG_LEN, "\"%016llx\"", (unsigned long long)h);
+}
+
+/**
+ * @brief Función principal de wpack.
+ * * Compila un directorio de contenido estático en un paquete que el servidor
+ * mapea en memoria con la opción -P. Uso: wpack [-z] <directorio> <paquete>.
+ * Con -z se guarda además una variante gzip de los archivos de texto, que se
+ * envía a los clientes que la aceptan. El paquete se escribe en
+ * <paquete>.tmp y se renombra al terminar, así que reemplazar el paquete de
+ * un despliegue es una operación atómica.
+ *
+ * @param argc El número de argumentos.
+ * @param argv El vector de argumentos.
+ * @return 0 en caso de éxito.
+ */
+int main(int argc, char *argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "z")) != -1) {
+        switch (c) {
+        case 'z':
+            use_gzip = 1;
+            break;
+        default:
+            fprintf(stderr, "Uso: wpack [-z] <directorio> <paquete>\n");
+            exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Uso: wpack [-z] <directorio> <paquete>\n");
+        exit(1);
+    }
+    root_dir = argv[optind];
+    const char *pack_path = argv[optind + 1];
+
+    if (nftw(root_dir, wpack_visit, 16, FTW_PHYS) != 0) {
+        perror("nftw");
+        exit(1);
+    }
+    qsort(files, file_count, sizeof(wpack_file_t), wpack_compare);
+
+    char tmp_path[MAXBUF];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", pack_path);
+    FILE *out = fopen(tmp_path, "wb");
+    if (out == NULL) {
+        perror(tmp_path);
+        exit(1);
+    }
+
+    pack_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    wpack_write(out, &hdr, sizeof(hdr));
+
+    pack_entry_t *entries = calloc(file_count > 0 ? file_count : 1, sizeof(pack_entry_t));
+    assert(entries != NULL);
+    for (int i = 0; i < file_count; i++) {
+        wpack_file_t *f = &files[i];
+        pack_entry_t *e = &entries[i];
+        e->data_off = wpack_write(out, f->data, f->size);
+        e->data_size = f->size;
+        if (f->gzip != NULL) {
+            e->gzip_off = wpack_write(out, f->gzip, f->gzip_size);
+            e->gzip_size = f->gzip_size;
+        }
+        e->path_off = wpack_write(out, f->path, strlen(f->path) + 1);
+        e->mime_off = wpack_write(out, f->mime, strlen(f->mime) + 1);
+        wpack_etag(f->data, f->size, e->etag);
+        printf("  %s (%s, %zu bytes%s)\n", f->path, f->mime, f->size, f->gzip ? ", gzip" : "");
+    }
+
+    memcpy(hdr.magic, PACK_MAGIC, sizeof(hdr.magic));
+    hdr.count = file_count;
+    hdr.index_off = wpack_write(out, entries, sizeof(pack_entry_t) * file_count);
+    hdr.size = ftell(out);
+    fseek(out, 0, SEEK_SET);
+    wpack_write(out, &hdr, sizeof(hdr));
+
+    if (fclose(out) != 0 || rename(tmp_path, pack_path) < 0) {
+        perror(pack_path);
+        exit(1);
+    }
+    printf("Paquete %s: %d archivos, %llu bytes\n", pack_path, file_count, (unsigned long long)hdr.size);
+    return 0;
+}
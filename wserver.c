@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,59 +7,74 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <limits.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 
 #include "request.h"
 #include "io_helper.h"
+#include "transfer.h"
+#include "tls.h"
+#include "http2.h"
+#include "cgi_cache.h"
+#include "pack.h"
+#include "trace.h"
+#include "sched.h"
+#include "costmodel.h"
+#include "plugin.h"
+#include "proxy.h"
+#include "ratelimit.h"
+#include "reload.h"
+#include "mempool.h"
+#include "prefetch.h"
 
 // --- Variables Globales ---
-// El estado compartido del servidor, incluyendo la configuración, el búfer de
-// peticiones y las primitivas de sincronización. Se inicializan en main().
+// La configuración y el estado compartido del servidor. Se inicializan en
+// main(); el búfer de peticiones y su sincronización están en sched.c.
 char default_root[] = ".";
 #define MAXBUF (8192) 
+#define ACCEPT_BATCH (64) // Conexiones aceptadas como máximo por vuelta del maestro.
+#define RELOAD_TIMEOUT_MS (10000) // Espera máxima a que el proceso nuevo esté listo.
+#define DRAIN_POLL_US (50000) // Intervalo de comprobación durante el drenado.
+#define DRAIN_TIMEOUT_STATUS (3) // Estado de salida si el drenado supera -G.
 
 off_t get_sff_filesize_peek(int conn_fd, const char* root_dir_path_for_stat);
+off_t get_filesize_for_uri(const char *method, const char *uri_from_req);
 void *worker_routine(void *arg);
 
-typedef struct {
-    int conn_fd; // Descriptor de archivo para la conexión del cliente.
-    off_t file_size_for_sff; // Tamaño del archivo solicitado (solo para SFF).
-} request_entry_t;
-
-request_entry_t *requests_buffer; // Búfer compartido para las peticiones.
 int num_threads_global; // Número de hilos trabajadores.
-int buffer_slots_global; // Capacidad del búfer.
-char *sched_alg_global; // Algoritmo de planificación (FIFO o SFF).
 char *root_dir_global; // Directorio raíz del servidor.
 
-volatile int buffer_count_global; // Número actual de peticiones en el búfer.
-int buffer_in_idx; // Índice para añadir peticiones (productor).
-int buffer_out_idx; // Índice para sacar peticiones (consumidor).
+// --- Transmisiones grandes ---
+// Cola de transmisiones por partes listas para enviar su siguiente turno.
+// Comparte buffer_mutex_global y buffer_not_empty_cond con el búfer.
+transfer_t *ready_transfers_head; // Primera transmisión lista.
+transfer_t *ready_transfers_tail; // Última transmisión lista.
+int transfer_turn_global; // 1 si el siguiente turno es para una transmisión.
+
+volatile sig_atomic_t stats_dump_requested; // SIGUSR1 pendiente de atender.
+volatile sig_atomic_t shutdown_requested; // SIGTERM: dejar de aceptar y terminar lo pendiente.
+volatile sig_atomic_t reload_requested; // SIGHUP: pasar los sockets a un proceso nuevo.
 
-pthread_mutex_t buffer_mutex_global; // Mutex para proteger el acceso al búfer.
-pthread_cond_t buffer_not_full_cond; // Condición para cuando el búfer no está lleno.
-pthread_cond_t buffer_not_empty_cond; // Condición para cuando el búfer no está vacío.
+// --- Apagado ordenado ---
+int busy_workers_global; // Trabajadores atendiendo una petición o transmisión (atómico).
+int workers_exit_global; // 1 cuando los trabajadores deben terminar; con buffer_mutex_global.
 
 /**
- * @brief Inspecciona una petición para obtener el tamaño del archivo solicitado.
- * * Esta función es una ayuda para la política de planificación SFF. Utiliza
- * recv() con la bandera MSG_PEEK para leer los datos iniciales de una petición
- * sin consumirlos del socket. Parsea la URI para determinar el nombre del
- * archivo y usa stat() para obtener su tamaño.
+ * @brief Lee la línea de petición sin consumirla del socket.
+ * * Utiliza recv() con la bandera MSG_PEEK para obtener el método y la URI de
+ * la petición, de modo que el trabajador pueda leerla después normalmente.
  *
  * @param conn_fd El descriptor de archivo de la conexión.
- * @param root_dir_path_for_stat El directorio raíz del servidor.
- * @return El tamaño del archivo en bytes (off_t) en caso de éxito, o un
- * valor negativo en caso de error o si no es una petición GET válida.
+ * @param method Búfer de salida (MAXBUF) para el método.
+ * @param uri Búfer de salida (MAXBUF) para la URI.
+ * @param flags Banderas adicionales para recv() (MSG_DONTWAIT para no
+ * esperar al cliente).
+ * @return 0 en caso de éxito, o un valor negativo si la línea no es válida.
  */
-off_t get_sff_filesize_peek(int conn_fd, const char* root_dir_path_for_stat) {
-    char peek_buf[MAXBUF];
-    char method[MAXBUF], uri_from_req[MAXBUF], version[MAXBUF]; 
-    char filename[MAXBUF];
-    struct stat sbuf;
+int peek_request_line(int conn_fd, char *method, char *uri, int flags) {
+    char peek_buf[MAXBUF], version[MAXBUF];
 
-    (void)root_dir_path_for_stat; 
-
-    ssize_t n = recv(conn_fd, peek_buf, MAXBUF - 1, MSG_PEEK);
+    ssize_t n = recv(conn_fd, peek_buf, MAXBUF - 1, MSG_PEEK | flags);
     if (n <= 0) {
         return -5; 
     }
@@ -73,10 +89,76 @@ off_t get_sff_filesize_peek(int conn_fd, const char* root_dir_path_for_stat) {
     }
     *first_line_end = '\0'; 
 
-    if (sscanf(peek_buf, "%s %s %s", method, uri_from_req, version) != 3) {
+    if (sscanf(peek_buf, "%s %s %s", method, uri, version) != 3) {
         return -7;
     }
-    
+    return 0;
+}
+
+/**
+ * @brief Indica si una URI se atiende con contenido dinámico.
+ * * Sigue el mismo criterio que request_parse_uri() (toda URI que contiene
+ * "cgi") y añade las rutas del proxy inverso y de los plugins.
+ */
+int uri_is_dynamic(const char *uri) {
+    return strstr(uri, "cgi") || proxy_match(uri) || plugin_match(uri) >= 0;
+}
+
+/**
+ * @brief Clasifica una petición como estática o dinámica (CGI).
+ * * Si la línea de petición no se puede leer, la petición se trata como
+ * estática, ya que será respondida con un error barato.
+ *
+ * @param conn_fd El descriptor de archivo de la conexión.
+ * @return REQ_CLASS_STATIC o REQ_CLASS_DYNAMIC.
+ */
+int classify_request_peek(int conn_fd) {
+    char method[MAXBUF], uri[MAXBUF];
+
+    if (peek_request_line(conn_fd, method, uri, 0) < 0) {
+        return REQ_CLASS_STATIC;
+    }
+    return uri_is_dynamic(uri) ? REQ_CLASS_DYNAMIC : REQ_CLASS_STATIC;
+}
+
+/**
+ * @brief Inspecciona una petición para obtener el tamaño del archivo solicitado.
+ * * Esta función es una ayuda para la política de planificación SFF. Utiliza
+ * recv() con la bandera MSG_PEEK para leer los datos iniciales de una petición
+ * sin consumirlos del socket. Parsea la URI para determinar el nombre del
+ * archivo y usa stat() para obtener su tamaño.
+ *
+ * @param conn_fd El descriptor de archivo de la conexión.
+ * @param root_dir_path_for_stat El directorio raíz del servidor.
+ * @return El tamaño del archivo en bytes (off_t) en caso de éxito, o un
+ * valor negativo en caso de error o si no es una petición GET válida.
+ */
+off_t get_sff_filesize_peek(int conn_fd, const char* root_dir_path_for_stat) {
+    char method[MAXBUF], uri_from_req[MAXBUF];
+
+    (void)root_dir_path_for_stat; 
+
+    int rc = peek_request_line(conn_fd, method, uri_from_req, 0);
+    if (rc < 0) {
+        return rc;
+    }
+    return get_filesize_for_uri(method, uri_from_req);
+}
+
+/**
+ * @brief Obtiene el tamaño del archivo que pide una línea de petición.
+ * * Parsea la URI para determinar el nombre del archivo (o del CGI) y usa
+ * stat(), o el índice del paquete si hay uno cargado, para obtener su tamaño.
+ *
+ * @param method El método de la petición.
+ * @param uri_from_req La URI de la petición.
+ * @return El tamaño del archivo en bytes, o un valor negativo en caso de
+ * error o si no es una petición GET válida.
+ */
+off_t get_filesize_for_uri(const char *method, const char *uri_from_req) {
+    char filename[MAXBUF];
+    struct stat sbuf;
+
     if (strcasecmp(method, "GET") != 0) {
         return -8; 
     }
@@ -103,6 +185,12 @@ off_t get_sff_filesize_peek(int conn_fd, const char* root_dir_path_for_stat) {
         snprintf(filename, MAXBUF, ".%s", temp_uri_for_parsing);
     }
 
+    // El tamaño del contenido empaquetado está en el índice.
+    if (pack_loaded() && !strstr(temp_uri_for_parsing, "cgi")) {
+        const pack_entry_t *entry = pack_lookup(filename);
+        return entry ? (off_t)entry->data_size : -1;
+    }
+
     if (stat(filename, &sbuf) < 0) {
         return -1; 
     }
@@ -110,12 +198,290 @@ off_t get_sff_filesize_peek(int conn_fd, const char* root_dir_path_for_stat) {
     return sbuf.st_size; 
 }
 
+/**
+ * @brief Estima el tiempo de servicio de una petición (para SEJF).
+ * * Las URIs dinámicas se buscan con su query string y sin tamaño; las
+ * estáticas, por su ruta y con el tamaño del archivo para cuando aún no
+ * se han visto.
+ *
+ * @param entry La entrada en la que se guardan la clave y el coste previsto.
+ * @param conn_fd El descriptor de archivo de la conexión.
+ */
+void estimate_cost_peek(request_entry_t *entry, int conn_fd) {
+    char method[MAXBUF], uri[MAXBUF];
+
+    entry->cost_key = 0;
+    entry->cost_dynamic = 0;
+    entry->file_size_for_sff = -1;
+    if (peek_request_line(conn_fd, method, uri, 0) == 0) {
+        int is_dynamic = uri_is_dynamic(uri);
+        entry->cost_key = costmodel_key(uri, is_dynamic);
+        entry->cost_dynamic = is_dynamic;
+        if (!is_dynamic) {
+            entry->file_size_for_sff = get_filesize_for_uri(method, uri);
+        }
+    }
+    entry->expected_cost = costmodel_predict(entry->cost_key, entry->file_size_for_sff);
+}
+
+/**
+ * @brief Pide precargar el archivo de una petición estática mientras espera
+ * en el búfer.
+ * * No espera al cliente: si la línea de petición aún no ha llegado, la
+ * petición no se precarga. Con un paquete cargado se precarga su rango del
+ * paquete (la variante sin comprimir, que es la de los archivos grandes).
+ *
+ * @param entry La entrada en la que se guarda el identificador de la precarga.
+ * @param conn_fd El descriptor de archivo de la conexión.
+ */
+void prefetch_request_peek(request_entry_t *entry, int conn_fd) {
+    char method[MAXBUF], uri[MAXBUF], filename[MAXBUF];
+
+    if (peek_request_line(conn_fd, method, uri, MSG_DONTWAIT) < 0 || strcasecmp(method, "GET") != 0 ||
+        strstr(uri, "..") || uri_is_dynamic(uri)) {
+        return;
+    }
+    // La misma ruta que construye request_parse_uri(); si no cabe, no se
+    // precarga.
+    if (snprintf(filename, MAXBUF, ".%s%s", uri, uri[strlen(uri) - 1] == '/' ? "index.html" : "") >= MAXBUF) {
+        return;
+    }
+    if (pack_loaded()) {
+        const pack_entry_t *pe = pack_lookup(filename);
+        if (pe != NULL && pe->data_size > 0) {
+            entry->prefetch_id = prefetch_range(pack_at(pe->data_off), pe->data_size);
+        }
+    } else {
+        entry->prefetch_id = prefetch_file(filename);
+    }
+}
+
+/**
+ * @brief Prepara la entrada del búfer para una conexión recién aceptada.
+ * * Inspecciona la petición con MSG_PEEK cuando la política lo necesita
+ * (tamaño para SFF, coste previsto para SEJF, clase para CLASS) y abre su
+ * registro de trazado.
+ *
+ * @param entry Salida: la entrada a encolar.
+ * @param conn_fd El descriptor de archivo de la conexión.
+ * @param is_tls 1 si la conexión llegó por el puerto HTTPS.
+ */
+void prepare_request_entry(request_entry_t *entry, int conn_fd, int is_tls) {
+    entry->conn_fd = conn_fd;
+    entry->file_size_for_sff = 0; 
+    entry->req_class = REQ_CLASS_STATIC;
+    entry->is_tls = is_tls;
+    entry->h2_stream = NULL;
+    entry->trace = trace_begin();
+    entry->cost_key = 0;
+    entry->cost_dynamic = 0;
+    entry->expected_cost = 0;
+    entry->prefetch_id = 0;
+
+    // Las peticiones HTTPS están cifradas hasta el handshake, que ocurre
+    // en el trabajador; no se pueden inspeccionar aquí. En SFF quedan
+    // con tamaño desconocido, en SEJF con el coste de una petición sin
+    // tamaño y en CLASS se tratan como estáticas.
+    if (is_tls) {
+        entry->file_size_for_sff = -1;
+        entry->expected_cost = costmodel_predict(0, -1);
+    } else if (sched_policy->peek == SCHED_PEEK_COST) {
+        estimate_cost_peek(entry, conn_fd);
+    } else if (sched_policy->peek == SCHED_PEEK_SIZE) {
+        entry->file_size_for_sff = get_sff_filesize_peek(conn_fd, root_dir_global);
+    } else if (sched_policy->peek == SCHED_PEEK_CLASS) {
+        entry->req_class = classify_request_peek(conn_fd);
+    }
+    if (!is_tls && sched_policy->peek != SCHED_PEEK_NONE) {
+        trace_stamp(entry->trace, TRACE_PEEK);
+    }
+    if (!is_tls && prefetch_enabled()) {
+        prefetch_request_peek(entry, conn_fd);
+    }
+}
+
+/**
+ * @brief Manejador de SIGUSR1: pide al maestro que muestre los contadores
+ * de memoria y de la limitación por cliente en cuanto vuelva de poll().
+ */
+void stats_signal_handler(int sig) {
+    (void)sig;
+    stats_dump_requested = 1;
+}
+
+/**
+ * @brief Manejador de SIGTERM y SIGHUP: el maestro los atiende en cuanto
+ * vuelva de ppoll().
+ */
+void lifecycle_signal_handler(int sig) {
+    if (sig == SIGHUP) {
+        reload_requested = 1;
+    } else {
+        shutdown_requested = 1;
+    }
+}
+
+/**
+ * @brief Indica si no queda trabajo pendiente: ni peticiones en el búfer,
+ * ni trabajadores ocupados, ni transmisiones, ni sesiones HTTP/2.
+ */
+int server_idle(void) {
+    pthread_mutex_lock(&buffer_mutex_global);
+    int idle = buffer_count_global == 0 && ready_transfers_head == NULL &&
+               __atomic_load_n(&busy_workers_global, __ATOMIC_RELAXED) == 0;
+    pthread_mutex_unlock(&buffer_mutex_global);
+    return idle && transfer_active() == 0 && http2_active_sessions() == 0;
+}
+
+/**
+ * @brief Añade a los argumentos los de un archivo de configuración.
+ * * El archivo contiene opciones de la línea de órdenes separadas por
+ * espacios o saltos de línea; lo que sigue a '#' es un comentario. Se
+ * aplican después de las de la línea de órdenes, así que prevalecen, y se
+ * vuelven a leer en cada recarga con SIGHUP.
+ *
+ * @param path La ruta del archivo.
+ * @param argc Entrada y salida: el número de argumentos.
+ * @param argv Los argumentos originales.
+ * @return Los argumentos combinados (terminados en NULL), o NULL si el
+ * archivo no se pudo leer.
+ */
+char **config_merge_args(const char *path, int *argc, char *argv[]) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    int count = *argc, capacity = *argc + 16;
+    char **args = malloc(sizeof(char *) * capacity);
+    assert(args != NULL);
+    memcpy(args, argv, sizeof(char *) * count);
+
+    char line[MAXBUF], *save;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        for (char *tok = strtok_r(line, " \t\r\n", &save); tok != NULL; tok = strtok_r(NULL, " \t\r\n", &save)) {
+            if (count + 1 >= capacity) {
+                capacity *= 2;
+                args = realloc(args, sizeof(char *) * capacity);
+                assert(args != NULL);
+            }
+            args[count++] = strdup(tok);
+        }
+    }
+    fclose(f);
+    args[count] = NULL;
+    *argc = count;
+    return args;
+}
+
+/**
+ * @brief Rechaza una conexión que superó su límite de conexiones.
+ * * Responde un 429 fijo sin pasar por el búfer ni por un trabajador. Lo
+ * que el cliente ya envió se descarta primero, para que close() no genere
+ * un RST que le impida leer la respuesta. En HTTPS solo se cierra, ya que
+ * el cliente espera un handshake.
+ *
+ * @param conn_fd La conexión, todavía no bloqueante.
+ * @param is_tls 1 si llegó por el puerto HTTPS.
+ */
+void reject_throttled(int conn_fd, int is_tls) {
+    static const char response[] = ""
+        "HTTP/1.1 429 Too Many Requests\r\n"
+        "Retry-After: 1\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n\r\n";
+    char discard[4096];
+
+    if (!is_tls) {
+        while (recv(conn_fd, discard, sizeof(discard), MSG_DONTWAIT) > 0)
+            ;
+        send(conn_fd, response, sizeof(response) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    close_or_die(conn_fd);
+}
+
+/**
+ * @brief Despierta a n trabajadores, uno por cada petición nueva.
+ * * Debe llamarse con buffer_mutex_global adquirido. Si hay más peticiones
+ * que trabajadores, un broadcast basta para despertarlos a todos.
+ */
+void wake_workers_locked(int n) {
+    if (n >= num_threads_global) {
+        pthread_cond_broadcast(&buffer_not_empty_cond);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_cond_signal(&buffer_not_empty_cond);
+    }
+}
+
+/**
+ * @brief Encola un stream HTTP/2 como una petición más del búfer.
+ * * La invoca el hilo de cada sesión HTTP/2 (http2.c) cuando un stream tiene
+ * su petición completa, de modo que los streams, y no las conexiones, son lo
+ * que planifican FIFO, SFF, SEJF y CLASS. Se bloquea si el búfer está lleno.
+ *
+ * @param stream El stream a procesar.
+ * @param size_for_sff El tamaño estimado de la respuesta (para SFF).
+ * @param is_dynamic 1 si la petición es para un CGI (para CLASS).
+ */
+void stream_enqueue(h2_stream_t *stream, off_t size_for_sff, int is_dynamic) {
+    request_entry_t entry;
+
+    entry.conn_fd = -1;
+    entry.file_size_for_sff = size_for_sff;
+    entry.req_class = is_dynamic ? REQ_CLASS_DYNAMIC : REQ_CLASS_STATIC;
+    entry.is_tls = 0;
+    entry.h2_stream = stream;
+    entry.trace = NULL;
+    entry.cost_key = 0;
+    entry.cost_dynamic = is_dynamic;
+    entry.prefetch_id = 0;
+    entry.expected_cost = costmodel_predict(0, is_dynamic ? -1 : size_for_sff);
+
+    pthread_mutex_lock(&buffer_mutex_global);
+    while (buffer_count_global == buffer_slots_global) {
+        pthread_cond_wait(&buffer_not_full_cond, &buffer_mutex_global);
+    }
+    enqueue_request_locked(&entry);
+    pthread_cond_signal(&buffer_not_empty_cond);
+    pthread_mutex_unlock(&buffer_mutex_global);
+}
+
+/**
+ * @brief Devuelve a los trabajadores una transmisión que puede continuar.
+ * * La invoca el motor de transmisiones (transfer.c) cuando una transmisión
+ * grande termina su turno o su socket vuelve a aceptar datos. Las
+ * transmisiones listas forman una cola FIFO, de modo que todas avanzan por
+ * turnos.
+ *
+ * @param t La transmisión lista para enviar su siguiente turno.
+ */
+void transfer_ready_enqueue(transfer_t *t) {
+    pthread_mutex_lock(&buffer_mutex_global);
+    t->next = NULL;
+    if (ready_transfers_tail) {
+        ready_transfers_tail->next = t;
+    } else {
+        ready_transfers_head = t;
+    }
+    ready_transfers_tail = t;
+    pthread_cond_signal(&buffer_not_empty_cond);
+    pthread_mutex_unlock(&buffer_mutex_global);
+}
+
 /**
  * @brief La rutina ejecutada por cada hilo trabajador (consumidor).
- * * En un bucle infinito, el hilo espera a que haya peticiones en el búfer.
- * Cuando hay trabajo disponible, extrae una petición según la política de
- * planificación (FIFO o SFF), la procesa llamando a request_handle(), y
- * finalmente cierra la conexión.
+ * * En un bucle infinito, el hilo espera a que haya peticiones en el búfer o
+ * transmisiones grandes listas para continuar. Alterna entre ambas fuentes
+ * para que las peticiones pequeñas no esperen detrás de las descargas
+ * grandes. Las peticiones se extraen según la política de planificación
+ * (FIFO, SFF, SEJF o CLASS), se procesan con request_handle() y, salvo que la
+ * conexión haya pasado al motor de transmisiones, se cierra la conexión.
  *
  * @param arg El ID numérico del trabajador, pasado como un puntero.
  * @return NULL.
@@ -125,66 +491,106 @@ void *worker_routine(void *arg) {
 		pthread_t self_id = pthread_self();
 
 		printf("[WORKER %ld/%lx] Hilo iniciado y listo.\n", worker_id_arg, (unsigned long)self_id);
+    plugin_thread_init();
 
     while (1) {
-        int fd_to_process = -1;
+        request_entry_t entry;
+        transfer_t *transfer_to_run = NULL;
         
         pthread_mutex_lock(&buffer_mutex_global);
 
-        while (buffer_count_global == 0) {
+        while (!requests_available_locked() && ready_transfers_head == NULL) {
+            // En el apagado el maestro solo lo pide cuando ya no queda trabajo.
+            if (workers_exit_global) {
+                pthread_mutex_unlock(&buffer_mutex_global);
+                trace_flush();
+						printf("[WORKER %ld/%lx] Terminando.\n", worker_id_arg, (unsigned long)self_id);
+                return NULL;
+            }
 						printf("[WORKER %ld/%lx] Buffer vacío. Esperando...\n", worker_id_arg, (unsigned long)self_id);
+            // Los registros de trazado pendientes no esperan a la siguiente petición.
+            pthread_mutex_unlock(&buffer_mutex_global);
+            trace_flush();
+            pthread_mutex_lock(&buffer_mutex_global);
+            if (requests_available_locked() || ready_transfers_head != NULL) {
+                continue;
+            }
             pthread_cond_wait(&buffer_not_empty_cond, &buffer_mutex_global);
 						printf("[WORKER %ld/%lx] Despertado. Buffer ya no está vacío.\n", worker_id_arg, (unsigned long)self_id);
         }
 
-        if (strcmp(sched_alg_global, "FIFO") == 0) {
-            fd_to_process = requests_buffer[buffer_out_idx].conn_fd;
+        if (ready_transfers_head != NULL && (transfer_turn_global || !requests_available_locked())) {
+            transfer_to_run = ready_transfers_head;
+            ready_transfers_head = transfer_to_run->next;
+            if (ready_transfers_head == NULL) {
+                ready_transfers_tail = NULL;
+            }
+            transfer_turn_global = 0;
         } else {
-            int SFF_chosen_idx_in_buffer_array = -1; 
-            off_t SFF_min_size = 0; 
-
-            for (int i = 0; i < buffer_count_global; i++) {
-                int current_item_actual_idx = (buffer_out_idx + i) % buffer_slots_global;
-                off_t current_size = requests_buffer[current_item_actual_idx].file_size_for_sff;
+            dequeue_request_locked(&entry);
+            transfer_turn_global = 1;
+            pthread_cond_signal(&buffer_not_full_cond); 
+        }
+        __atomic_fetch_add(&busy_workers_global, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&buffer_mutex_global);
 
-                if (current_size >= 0) { 
-                    if (SFF_chosen_idx_in_buffer_array == -1 || current_size < SFF_min_size) {
-                        SFF_min_size = current_size;
-                        SFF_chosen_idx_in_buffer_array = current_item_actual_idx;
-                    }
-                }
-            }
+        if (transfer_to_run != NULL) {
+            transfer_run(transfer_to_run);
+            __atomic_fetch_sub(&busy_workers_global, 1, __ATOMIC_RELAXED);
+            continue;
+        }
 
-            if (SFF_chosen_idx_in_buffer_array == -1) { 
-                 if (buffer_count_global > 0) { 
-                    SFF_chosen_idx_in_buffer_array = buffer_out_idx; 
-                 } else {
-                    pthread_mutex_unlock(&buffer_mutex_global);
-                    continue; 
-                 }
-            }
-            
-            if (SFF_chosen_idx_in_buffer_array != buffer_out_idx) {
-                request_entry_t temp = requests_buffer[buffer_out_idx];
-                requests_buffer[buffer_out_idx] = requests_buffer[SFF_chosen_idx_in_buffer_array];
-                requests_buffer[SFF_chosen_idx_in_buffer_array] = temp;
-            }
-            fd_to_process = requests_buffer[buffer_out_idx].conn_fd;
+        trace_stamp(entry.trace, TRACE_DEQUEUE);
+        prefetch_release(entry.prefetch_id);
+        trace_set_current(entry.trace);
+        trace_set_worker((uint32_t)worker_id_arg);
+        if (entry.is_tls) {
+            trace_set_flags(TRACE_F_TLS);
         }
-        
-        buffer_out_idx = (buffer_out_idx + 1) % buffer_slots_global;
-        buffer_count_global--;
 
-        pthread_cond_signal(&buffer_not_full_cond); 
-        pthread_mutex_unlock(&buffer_mutex_global);
+        // Las conexiones HTTPS completan aquí el handshake, fuera del hilo
+        // maestro; el resto del procesamiento usa el descriptor en claro.
+        int fd_to_process = entry.conn_fd;
+        if (entry.h2_stream != NULL) {
+            http2_stream_process(entry.h2_stream);
+        } else if (entry.is_tls) {
+            fd_to_process = tls_accept(fd_to_process);
+        }
 
-        if (fd_to_process != -1) {
+        if (fd_to_process >= 0) {
 						printf("[WORKER %ld/%lx] Procesando FD=%d...\n", worker_id_arg, (unsigned long)self_id, fd_to_process);
-            request_handle(fd_to_process, root_dir_global); 
-
+            struct timespec t_start, t_end;
+            clock_gettime(CLOCK_MONOTONIC, &t_start);
+            if (request_handle(fd_to_process, root_dir_global) == 0) {
 						printf("[WORKER %ld/%lx] Finalizado FD=%d. Cerrando conexión.\n", worker_id_arg, (unsigned long)self_id, fd_to_process);
-            close_or_die(fd_to_process);
+                close_or_die(fd_to_process);
+                trace_mark(TRACE_CLOSE);
+                // El modelo de SEJF aprende del tiempo de servicio medido. Las
+                // conexiones que pasan al motor de transmisiones no se miden:
+                // su coste lo estima el ajuste por tamaño.
+                if (entry.cost_key != 0) {
+                    clock_gettime(CLOCK_MONOTONIC, &t_end);
+                    costmodel_observe(entry.cost_key, entry.file_size_for_sff, entry.cost_dynamic,
+                                      (t_end.tv_sec - t_start.tv_sec) * 1e6 + (t_end.tv_nsec - t_start.tv_nsec) / 1e3);
+                }
+            }
+        }
+        // Si la conexión pasó al motor de transmisiones, este ya se quedó con
+        // el registro; en otro caso (incluido HTTP/2) termina aquí.
+        trace_end(trace_take_current());
+        // Lo reservado para la petición en la arena se libera de una vez.
+        arena_reset(arena_thread());
+
+        if (entry.req_class >= 0) {
+            // Libera el cupo de la clase; otro trabajador podría estar
+            // esperando únicamente porque la clase había alcanzado su tope.
+            pthread_mutex_lock(&buffer_mutex_global);
+            if (release_request_locked(&entry)) {
+                pthread_cond_signal(&buffer_not_empty_cond);
+            }
+            pthread_mutex_unlock(&buffer_mutex_global);
         }
+        __atomic_fetch_sub(&busy_workers_global, 1, __ATOMIC_RELAXED);
     }
     return NULL;
 }
@@ -203,13 +609,53 @@ void *worker_routine(void *arg) {
 int main(int argc, char *argv[]) {
     // Parseo de argumentos
     int c;
+    int arg_count = argc;
+    char **args = argv;
+    int drain_timeout_arg = 30;
+    long prefetch_budget_arg = 0;
     char *root_dir_arg = default_root;
     int port = 10000;
     int num_threads_arg = 1;
     int num_buffers_arg = 1;
     char *sched_alg_arg = "FIFO";
+    int weight_static_arg = 4;
+    int weight_dynamic_arg = 1;
+    int max_dynamic_workers_arg = 0;
+    long chunk_size_arg = 256 * 1024;
+    long rate_limit_arg = 0;
+    int tls_port = -1;
+    char *tls_cert_arg = "cert.pem";
+    char *tls_key_arg = "key.pem";
+    int cgi_cache_ttl_arg = -1;
+    char *pack_arg = NULL;
+    char *trace_arg = NULL;
+    int trace_sample_arg = 100;
+    int defer_accept_arg = 0;
+    int proxy_least_conn_arg = 0;
+    int proxy_timeout_arg = 5000;
+    double ip_rate_arg = 0, ip_burst_arg = 0, subnet_rate_arg = 0, subnet_burst_arg = 0;
+
+    // Para una recarga hacen falta el binario, los argumentos originales y el
+    // directorio de arranque, que chdir() cambia después.
+    char exe_path[PATH_MAX], startup_cwd[PATH_MAX];
+    ssize_t exe_len = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    exe_path[exe_len > 0 ? exe_len : 0] = '\0';
+    if (getcwd(startup_cwd, sizeof(startup_cwd)) == NULL) {
+        startup_cwd[0] = '\0';
+    }
+
+    // El archivo de configuración (-F) se lee antes que el resto de opciones.
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            args = config_merge_args(argv[i + 1], &arg_count, argv);
+            if (args == NULL) {
+                exit(1);
+            }
+            break;
+        }
+    }
 
-    while ((c = getopt(argc, argv, "d:p:t:b:s:")) != -1) {
+    while ((c = getopt(arg_count, args, "d:p:t:b:s:w:c:k:r:S:C:K:m:P:T:n:D:x:B:X:L:N:l:F:G:A:")) != -1) {
         switch (c) {
         case 'd':
             root_dir_arg = optarg;
@@ -237,116 +683,404 @@ int main(int argc, char *argv[]) {
             break;
         case 's':
             sched_alg_arg = optarg;
-            if (strcmp(sched_alg_arg, "FIFO") != 0 && strcmp(sched_alg_arg, "SFF") != 0) {
-                fprintf(stderr, "La política de agendamiento debe ser FIFO o SFF\n");
+            if (sched_policy_find(sched_alg_arg) == NULL) {
+                fprintf(stderr, "La política de agendamiento debe ser FIFO, SFF, SEJF o CLASS\n");
+                exit(1);
+            }
+            break;
+        case 'w':
+            if (sscanf(optarg, "%d:%d", &weight_static_arg, &weight_dynamic_arg) != 2 ||
+                weight_static_arg <= 0 || weight_dynamic_arg <= 0) {
+                fprintf(stderr, "Los pesos deben tener la forma estatico:dinamico y ser positivos\n");
+                exit(1);
+            }
+            break;
+        case 'c':
+            max_dynamic_workers_arg = atoi(optarg);
+            if (max_dynamic_workers_arg <= 0) {
+                fprintf(stderr, "El tope de hilos para CGI debe ser positivo\n");
+                exit(1);
+            }
+            break;
+        case 'k':
+            chunk_size_arg = atol(optarg);
+            if (chunk_size_arg < 0) {
+                fprintf(stderr, "El tamaño de turno no puede ser negativo\n");
+                exit(1);
+            }
+            break;
+        case 'r':
+            rate_limit_arg = atol(optarg);
+            if (rate_limit_arg < 0) {
+                fprintf(stderr, "El límite de ancho de banda no puede ser negativo\n");
+                exit(1);
+            }
+            break;
+        case 'S':
+            tls_port = atoi(optarg);
+            if (tls_port < 0 || tls_port > 65535) {
+                fprintf(stderr, "Número de puerto HTTPS invalido %d. Debe estar 0-65535.\n", tls_port);
+                exit(1);
+            }
+            break;
+        case 'C':
+            tls_cert_arg = optarg;
+            break;
+        case 'K':
+            tls_key_arg = optarg;
+            break;
+        case 'm':
+            cgi_cache_ttl_arg = atoi(optarg);
+            if (cgi_cache_ttl_arg < 0) {
+                fprintf(stderr, "El TTL de la caché de CGI no puede ser negativo\n");
+                exit(1);
+            }
+            break;
+        case 'P':
+            pack_arg = optarg;
+            break;
+        case 'T':
+            trace_arg = optarg;
+            break;
+        case 'n':
+            trace_sample_arg = atoi(optarg);
+            if (trace_sample_arg <= 0) {
+                fprintf(stderr, "La tasa de muestreo del trazado debe ser positiva\n");
+                exit(1);
+            }
+            break;
+        case 'D':
+            defer_accept_arg = atoi(optarg);
+            if (defer_accept_arg <= 0) {
+                fprintf(stderr, "El tiempo de TCP_DEFER_ACCEPT debe ser positivo\n");
+                exit(1);
+            }
+            break;
+        case 'x':
+            if (proxy_add_route(optarg) < 0) {
+                exit(1);
+            }
+            break;
+        case 'B':
+            if (strcmp(optarg, "rr") != 0 && strcmp(optarg, "lc") != 0) {
+                fprintf(stderr, "El reparto del proxy debe ser rr o lc\n");
+                exit(1);
+            }
+            proxy_least_conn_arg = strcmp(optarg, "lc") == 0;
+            break;
+        case 'X':
+            proxy_timeout_arg = atoi(optarg);
+            if (proxy_timeout_arg <= 0) {
+                fprintf(stderr, "El tiempo límite del proxy debe ser positivo\n");
+                exit(1);
+            }
+            break;
+        case 'L':
+        case 'N': {
+            double rate = 0, burst = 0;
+            int n = sscanf(optarg, "%lf:%lf", &rate, &burst);
+            if (n < 1 || rate <= 0 || (n == 2 && burst < 1)) {
+                fprintf(stderr, "El límite debe tener la forma conexiones_por_segundo[:rafaga]\n");
+                exit(1);
+            }
+            // Sin ráfaga explícita se permite un segundo de conexiones seguidas.
+            if (n == 1) {
+                burst = rate;
+            }
+            if (c == 'L') {
+                ip_rate_arg = rate;
+                ip_burst_arg = burst;
+            } else {
+                subnet_rate_arg = rate;
+                subnet_burst_arg = burst;
+            }
+            break;
+        }
+        case 'l':
+            // Los plugins se cargan antes de chdir(), como el certificado.
+            if (plugin_load(optarg) < 0) {
+                exit(1);
+            }
+            break;
+        case 'F':
+            // Ya combinado con los argumentos.
+            break;
+        case 'G':
+            drain_timeout_arg = atoi(optarg);
+            if (drain_timeout_arg <= 0) {
+                fprintf(stderr, "El tiempo de drenado debe ser positivo\n");
+                exit(1);
+            }
+            break;
+        case 'A':
+            prefetch_budget_arg = atol(optarg);
+            if (prefetch_budget_arg <= 0) {
+                fprintf(stderr, "El presupuesto de precarga debe ser positivo (en MiB)\n");
                 exit(1);
             }
             break;
         default:
-            fprintf(stderr, "Uso: wserver [-d basedir] [-p port] [-t threads] [-b buffers] [-s schedalg]\n");
+            fprintf(stderr, "Uso: wserver [-d basedir] [-p port] [-t threads] [-b buffers] [-s schedalg] [-w wstatic:wdynamic] [-c maxcgi] [-k chunkbytes] [-r bytespersec] [-S httpsport -C cert.pem -K key.pem] [-m cgicachettl] [-P pack] [-T trace.bin [-n sampleevery]] [-D deferseconds] [-x prefix=host:port,... [-B rr|lc] [-X timeoutms]] [-L ippersec[:burst]] [-N subnetpersec[:burst]] [-l plugin.so] [-F config] [-G drainseconds] [-A prefetchmib]\n");
             exit(1);
         }
     }
 
+    // El límite de ancho de banda lo aplica el motor de transmisiones.
+    if (rate_limit_arg > 0 && chunk_size_arg == 0) {
+        fprintf(stderr, "El límite de ancho de banda (-r) requiere el envío por partes (-k distinto de 0)\n");
+        exit(1);
+    }
+
     // Inicialización del servidor
     num_threads_global = num_threads_arg;
-    buffer_slots_global = num_buffers_arg;
-    sched_alg_global = strdup(sched_alg_arg); 
     root_dir_global = strdup(root_dir_arg);   
 
+    // El certificado se carga antes de chdir() para que las rutas relativas
+    // se resuelvan respecto al directorio desde el que se lanzó el servidor.
+    if (tls_port >= 0 && tls_init(tls_cert_arg, tls_key_arg) < 0) {
+        fprintf(stderr, "No se pudo cargar el certificado %s o la clave %s\n", tls_cert_arg, tls_key_arg);
+        exit(1);
+    }
+
+    if (pack_arg != NULL && pack_open(pack_arg) < 0) {
+        exit(1);
+    }
+    // Si este proceso sustituye a otro (SIGHUP), hereda sus sockets de
+    // escucha y continúa su archivo de trazas en lugar de truncarlo.
+    int inherited_fds[RELOAD_MAX_FDS];
+    int num_inherited = reload_inherit(inherited_fds, RELOAD_MAX_FDS);
+    if (num_inherited < 0) {
+        exit(1);
+    }
+    if (trace_arg != NULL && trace_init(trace_arg, trace_sample_arg, num_inherited > 0) < 0) {
+        exit(1);
+    }
+
+    // Las señales del ciclo de vida solo se atienden en el ppoll() del
+    // maestro: se bloquean antes de crear cualquier hilo, que hereda la
+    // máscara, para que ninguna interrumpa la E/S de un trabajador.
+    sigset_t lifecycle_signals, master_wait_mask;
+    sigemptyset(&lifecycle_signals);
+    sigaddset(&lifecycle_signals, SIGTERM);
+    sigaddset(&lifecycle_signals, SIGHUP);
+    sigaddset(&lifecycle_signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &lifecycle_signals, &master_wait_mask);
+    struct sigaction lifecycle_sa;
+    memset(&lifecycle_sa, 0, sizeof(lifecycle_sa));
+    lifecycle_sa.sa_handler = lifecycle_signal_handler;
+    sigemptyset(&lifecycle_sa.sa_mask);
+    sigaction(SIGTERM, &lifecycle_sa, NULL);
+    sigaction(SIGHUP, &lifecycle_sa, NULL);
+    // Un cliente que cierra la conexión no debe terminar el proceso.
+    signal(SIGPIPE, SIG_IGN);
+
     chdir_or_die(root_dir_global);
 
     // Asignación de memoria para el búfer y las primitivas de sincronización
-    requests_buffer = (request_entry_t *)malloc(sizeof(request_entry_t) * buffer_slots_global);
-    if (requests_buffer == NULL) {
-        perror("No se pudo asignar el búfer de solicitudes");
-        free(sched_alg_global);
+    if (sched_init(sched_alg_arg, num_buffers_arg, num_threads_global, weight_static_arg, weight_dynamic_arg,
+                   max_dynamic_workers_arg) < 0) {
         free(root_dir_global);
         exit(1);
     }
-    buffer_count_global = 0;
-    buffer_in_idx = 0;
-    buffer_out_idx = 0;
 
-    pthread_mutex_init(&buffer_mutex_global, NULL);
-    pthread_cond_init(&buffer_not_full_cond, NULL);
-    pthread_cond_init(&buffer_not_empty_cond, NULL);
+    ready_transfers_head = NULL;
+    ready_transfers_tail = NULL;
+    transfer_turn_global = 0;
+    transfer_init(chunk_size_arg, rate_limit_arg, transfer_ready_enqueue);
+    http2_init(stream_enqueue);
+    cgi_cache_init(cgi_cache_ttl_arg);
+    costmodel_init();
+    prefetch_init((size_t)prefetch_budget_arg * 1024 * 1024);
+    proxy_configure(proxy_least_conn_arg, proxy_timeout_arg);
+    ratelimit_init(ip_rate_arg, ip_burst_arg, subnet_rate_arg, subnet_burst_arg);
+    // Sin SA_RESTART, para que la señal interrumpa el ppoll() del maestro.
+    struct sigaction stats_sa;
+    memset(&stats_sa, 0, sizeof(stats_sa));
+    stats_sa.sa_handler = stats_signal_handler;
+    sigemptyset(&stats_sa.sa_mask);
+    sigaction(SIGUSR1, &stats_sa, NULL);
 
     // Creación del pool de hilos trabajadores
     pthread_t *worker_threads_arr = (pthread_t *)malloc(sizeof(pthread_t) * num_threads_global);
     if (worker_threads_arr == NULL) {
         perror("No se pudo asignar la matriz de subprocesos de trabajo");
-        free(requests_buffer); 
-        free(sched_alg_global);
+        sched_destroy();
         free(root_dir_global);
         exit(1);
     }
     for (long i = 0; i < num_threads_global; i++) {
         if (pthread_create(&worker_threads_arr[i], NULL, worker_routine, (void *)i) != 0) {
             perror("No se pudo crear el hilo de trabajo");
-            free(requests_buffer);
+            sched_destroy();
             free(worker_threads_arr); 
-            free(sched_alg_global);
             free(root_dir_global);
             exit(1); 
         }
     }
 
-    // Bucle principal del productor
-    int listen_fd = open_listen_fd_or_die(port);
+    // Bucle principal del productor. Tras una recarga los sockets de escucha
+    // son los del proceso anterior, así que -p y -S no pueden cambiar.
+    int listen_fd = num_inherited > 0 ? inherited_fds[0] : open_listen_fd_or_die(port);
+    int tls_listen_fd = -1;
     printf("Servidor escuchando en el puerto %d con %d hilos, %d buffers, %s scheduling, root dir %s\n",
            port, num_threads_global, buffer_slots_global, sched_alg_global, root_dir_global);
+    if (num_inherited > 1 && tls_port < 0) {
+        close_or_die(inherited_fds[1]);
+    } else if (tls_port >= 0) {
+        tls_listen_fd = num_inherited > 1 ? inherited_fds[1] : open_listen_fd_or_die(tls_port);
+        printf("Servidor escuchando HTTPS en el puerto %d\n", tls_port);
+    }
 
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr); 
-        int conn_fd = accept_or_die(listen_fd, (sockaddr_t *)&client_addr, &client_len);
-				printf("[MASTER] Conexión aceptada: FD=%d\n", conn_fd);
+    // Los sockets de escucha son no bloqueantes: el maestro solo se bloquea
+    // en poll() y después vacía la cola de accept por lotes.
+    int listen_fds[2] = { listen_fd, tls_listen_fd };
+    int num_listen_fds = tls_listen_fd >= 0 ? 2 : 1;
+    for (int i = 0; i < num_listen_fds; i++) {
+        fcntl(listen_fds[i], F_SETFL, fcntl(listen_fds[i], F_GETFL) | O_NONBLOCK);
+        // Los CGI no heredan los sockets; una recarga los pasa explícitamente.
+        fcntl(listen_fds[i], F_SETFD, FD_CLOEXEC);
+        // Con -D el kernel no entrega la conexión hasta que llegan datos,
+        // así que el peek de SFF/CLASS no espera al cliente.
+        if (defer_accept_arg > 0 &&
+            setsockopt(listen_fds[i], IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept_arg, sizeof(int)) < 0) {
+            perror("setsockopt(TCP_DEFER_ACCEPT)");
+        }
+    }
 
-        // Preprocesamiento para SFF
-        request_entry_t current_req_entry;
-        current_req_entry.conn_fd = conn_fd;
-        current_req_entry.file_size_for_sff = 0; 
+    reload_notify_ready();
 
-        if (strcmp(sched_alg_global, "SFF") == 0) {
-            off_t size = get_sff_filesize_peek(conn_fd, root_dir_global);
-            current_req_entry.file_size_for_sff = size;
+    while (!shutdown_requested) {
+        struct pollfd listen_pfds[2] = {
+            { .fd = listen_fd, .events = POLLIN },
+            { .fd = tls_listen_fd, .events = POLLIN },
+        };
+        int poll_rc = ppoll(listen_pfds, num_listen_fds, NULL, &master_wait_mask);
+        if (stats_dump_requested) {
+            stats_dump_requested = 0;
+            if (ratelimit_enabled()) {
+                ratelimit_dump();
+            }
+            mempool_dump();
+            if (prefetch_enabled()) {
+                prefetch_dump();
+            }
+        }
+        if (reload_requested) {
+            reload_requested = 0;
+            printf("[MASTER] SIGHUP: arrancando el proceso nuevo...\n");
+            int ready_fd;
+            pid_t pid = reload_spawn(exe_path, argv, startup_cwd, listen_fds, num_listen_fds, &ready_fd);
+            if (pid > 0 && reload_wait_ready(ready_fd, pid, RELOAD_TIMEOUT_MS) == 0) {
+                printf("[MASTER] El proceso %d acepta las conexiones; este termina lo pendiente.\n", (int)pid);
+                break;
+            }
+            fprintf(stderr, "[MASTER] La recarga falló; se sigue con este proceso.\n");
+            continue;
+        }
+        if (poll_rc < 0) {
+            continue;
         }
 
-        // Añadir al buffer
+        request_entry_t batch[ACCEPT_BATCH];
+        int batch_count = 0;
+        for (int l = 0; l < num_listen_fds; l++) {
+            if (!(listen_pfds[l].revents & POLLIN)) {
+                continue;
+            }
+            while (batch_count < ACCEPT_BATCH) {
+                struct sockaddr_in client_addr;
+                socklen_t client_len = sizeof(client_addr);
+                int conn_fd = accept4(listen_pfds[l].fd, (sockaddr_t *)&client_addr, &client_len,
+                                      SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (conn_fd < 0) {
+                    if (errno == ECONNABORTED || errno == EINTR) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        perror("accept4");
+                    }
+                    break;
+                }
+                // Los clientes que superan su límite no llegan a ocupar el búfer.
+                if (ratelimit_enabled() && client_addr.sin_family == AF_INET &&
+                    ratelimit_allow(client_addr.sin_addr.s_addr) != RATELIMIT_ALLOW) {
+                    reject_throttled(conn_fd, l == 1);
+                    continue;
+                }
+                // Los trabajadores usan E/S bloqueante sobre la conexión.
+                fcntl(conn_fd, F_SETFL, fcntl(conn_fd, F_GETFL) & ~O_NONBLOCK);
+				printf("[MASTER] Conexión aceptada: FD=%d\n", conn_fd);
+                prepare_request_entry(&batch[batch_count++], conn_fd, l == 1);
+            }
+        }
+        if (batch_count == 0) {
+            continue;
+        }
+
+        // Todo el lote se añade al buffer con una sola adquisición del mutex.
         pthread_mutex_lock(&buffer_mutex_global);
-				printf("[MASTER] Intentando encolar FD=%d. Buffer actual: %d/%d\n", conn_fd, buffer_count_global, buffer_slots_global);
+				printf("[MASTER] Intentando encolar %d conexiones. Buffer actual: %d/%d\n", batch_count, buffer_count_global, buffer_slots_global);
 
-        // Espera si el buffer está lleno
-        while (buffer_count_global == buffer_slots_global) {
-						printf("[MASTER] Buffer lleno. Esperando para encolar FD=%d...\n", conn_fd);
-            pthread_cond_wait(&buffer_not_full_cond, &buffer_mutex_global);
-						printf("[MASTER] Despertado. Buffer ya no está lleno. Intentando encolar FD=%d de nuevo.\n", conn_fd);
+        int pending_wakeups = 0;
+        for (int i = 0; i < batch_count; i++) {
+            // Espera si el buffer está lleno
+            while (buffer_count_global == buffer_slots_global) {
+                wake_workers_locked(pending_wakeups);
+                pending_wakeups = 0;
+						printf("[MASTER] Buffer lleno. Esperando para encolar FD=%d...\n", batch[i].conn_fd);
+                pthread_cond_wait(&buffer_not_full_cond, &buffer_mutex_global);
+            }
+            trace_stamp(batch[i].trace, TRACE_ENQUEUE);
+            int enqueued_at_idx = enqueue_request_locked(&batch[i]);
+            pending_wakeups++;
+				printf("[MASTER] FD=%d encolado en slot %d. Buffer ahora: %d/%d\n", batch[i].conn_fd, enqueued_at_idx, buffer_count_global, buffer_slots_global);
         }
 
-        requests_buffer[buffer_in_idx] = current_req_entry;
-				int enqueued_at_idx = buffer_in_idx;
-        buffer_in_idx = (buffer_in_idx + 1) % buffer_slots_global;
-        buffer_count_global++;
-
-				printf("[MASTER] FD=%d encolado en slot %d. Buffer ahora: %d/%d\n", conn_fd, enqueued_at_idx, buffer_count_global, buffer_slots_global);
-        
-        // Avisa a un trabajador que hay trabajo disponible
-        pthread_cond_signal(&buffer_not_empty_cond);
+        // Despierta a tantos trabajadores como peticiones nuevas hay
+        wake_workers_locked(pending_wakeups);
         pthread_mutex_unlock(&buffer_mutex_global);
     }
 
+    // Drenado: no se aceptan más conexiones (tras una recarga las acepta el
+    // proceso nuevo) y se termina todo lo que ya estaba dentro.
+    close_or_die(listen_fd); 
+    if (tls_listen_fd >= 0) {
+        close_or_die(tls_listen_fd);
+    }
+    http2_drain();
+    printf("[MASTER] Dejando de aceptar conexiones; terminando las peticiones en curso...\n");
+    time_t drain_deadline = time(NULL) + drain_timeout_arg;
+    while (!server_idle()) {
+        if (time(NULL) >= drain_deadline) {
+            // Los trabajadores ociosos terminan y vacían sus trazas; los que
+            // siguen ocupados se abandonan con el proceso.
+            pthread_mutex_lock(&buffer_mutex_global);
+            fprintf(stderr, "[MASTER] Tiempo de drenado agotado; se abandonan %d peticiones en el búfer, %d en los "
+                            "trabajadores, %d transmisiones y %d sesiones HTTP/2.\n",
+                    buffer_count_global, __atomic_load_n(&busy_workers_global, __ATOMIC_RELAXED), transfer_active(),
+                    http2_active_sessions());
+            workers_exit_global = 1;
+            pthread_cond_broadcast(&buffer_not_empty_cond);
+            pthread_mutex_unlock(&buffer_mutex_global);
+            trace_flush();
+            exit(DRAIN_TIMEOUT_STATUS);
+        }
+        usleep(DRAIN_POLL_US);
+    }
+
+    // Los trabajadores vacían sus registros de trazado al salir.
+    pthread_mutex_lock(&buffer_mutex_global);
+    workers_exit_global = 1;
+    pthread_cond_broadcast(&buffer_not_empty_cond);
+    pthread_mutex_unlock(&buffer_mutex_global);
     for (int i = 0; i < num_threads_global; i++) {
         pthread_join(worker_threads_arr[i], NULL); 
     }
-    free(requests_buffer);
+    mempool_dump();
+    printf("[MASTER] Servidor detenido.\n");
+    sched_destroy();
     free(worker_threads_arr);
-    free(sched_alg_global);
     free(root_dir_global);
-    pthread_mutex_destroy(&buffer_mutex_global);
-    pthread_cond_destroy(&buffer_not_full_cond);
-    pthread_cond_destroy(&buffer_not_empty_cond);
-    close_or_die(listen_fd); 
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "io_helper.h"
+#include "sched.h"
+#include "costmodel.h"
+#include <float.h>
+
+#define MAXBUF (8192)
+
+// Una petición de la traza. Los tiempos están en microsegundos.
+typedef struct {
+    double arrival; // Llegada, relativa a la primera petición.
+    off_t size; // Lo que vería el peek de SFF (negativo = desconocido).
+    int dynamic; // 1 si es un CGI.
+    double service; // Tiempo que un trabajador tarda en atenderla.
+    double start; // Salida: momento en que un trabajador la extrajo.
+    double finish; // Salida: momento en que terminó.
+} wsim_request_t;
+
+// Un hilo trabajador simulado.
+typedef struct {
+    int busy;
+    double busy_until;
+    request_entry_t entry; // Petición que atiende, como la devolvió la política.
+} wsim_worker_t;
+
+static wsim_request_t *requests;
+static int request_count;
+static off_t cgi_peek_size = -1; // Tamaño que el peek de SFF da a los CGI (-g), o -1 si no se indicó.
+
+static int compare_arrival(const void *a, const void *b) {
+    double x = ((const wsim_request_t *)a)->arrival, y = ((const wsim_request_t *)b)->arrival;
+    return (x > y) - (x < y);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Añade una petición a la traza en memoria.
+ */
+static void wsim_add(double arrival, off_t size, int dynamic, double service) {
+    static int capacity;
+    if (request_count == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        requests = realloc(requests, sizeof(wsim_request_t) * capacity);
+        assert(requests != NULL);
+    }
+    wsim_request_t *r = &requests[request_count++];
+    r->arrival = arrival;
+    r->size = size;
+    r->dynamic = dynamic;
+    r->service = service;
+}
+
+/**
+ * @brief Carga una traza binaria escrita por el servidor con -T.
+ * * La llegada es la marca de accept, el tamaño son los bytes del cuerpo y
+ * el tiempo de servicio va de dequeue a close. Se omiten los registros sin
+ * esas marcas (conexiones que pasaron a HTTP/2). Las peticiones HTTPS
+ * conservan el tamaño desconocido que ve el maestro.
+ */
+static void wsim_load_trace(FILE *in, const char *path) {
+    trace_file_header_t hdr;
+    trace_record_t rec;
+
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.num_stages != TRACE_NUM_STAGES ||
+        hdr.record_size != sizeof(trace_record_t)) {
+        fprintf(stderr, "%s no es un archivo de trazas compatible\n", path);
+        exit(1);
+    }
+    while (fread(&rec, sizeof(rec), 1, in) == 1) {
+        if (rec.ts[TRACE_DEQUEUE] == 0 || rec.ts[TRACE_CLOSE] == 0) {
+            continue;
+        }
+        off_t size = (rec.flags & TRACE_F_TLS) ? -1 : (off_t)rec.bytes;
+        wsim_add(rec.ts[TRACE_ACCEPT] / 1000.0, size, (rec.flags & TRACE_F_DYNAMIC) != 0,
+                 (rec.ts[TRACE_CLOSE] - rec.ts[TRACE_DEQUEUE]) / 1000.0);
+    }
+}
+
+/**
+ * @brief Carga una traza de texto: una petición por línea con
+ * "llegada_us tamaño static|cgi servicio_us". Las líneas que empiezan por
+ * '#' se ignoran.
+ */
+static void wsim_load_text(FILE *in, const char *path) {
+    char line[MAXBUF], type[MAXBUF];
+    double arrival, service;
+    long long size;
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        lineno++;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (sscanf(line, "%lf %lld %s %lf", &arrival, &size, type, &service) != 4 ||
+            (strcmp(type, "static") != 0 && strcmp(type, "cgi") != 0) || service < 0) {
+            fprintf(stderr, "%s:%d: línea no válida\n", path, lineno);
+            exit(1);
+        }
+        wsim_add(arrival, (off_t)size, strcmp(type, "cgi") == 0, service);
+    }
+}
+
+/**
+ * @brief Estima el coste de una petición con el modelo aprendido (SEJF).
+ * * Las trazas no guardan la URI, así que la clave es el tipo y el tamaño
+ * de la respuesta: en el contenido estático equivale a la ruta y en los
+ * CGI separa las respuestas distintas de un mismo script. Como en el
+ * servidor, los CGI y las peticiones HTTPS se estiman sin tamaño.
+ */
+static void wsim_estimate_cost(request_entry_t *entry, const wsim_request_t *r) {
+    char key[64];
+
+    if (r->size < 0) {
+        entry->cost_key = 0;
+        entry->cost_dynamic = r->dynamic;
+        entry->file_size_for_sff = -1;
+    } else {
+        snprintf(key, sizeof(key), "/%s/%lld", r->dynamic ? "cgi" : "static", (long long)r->size);
+        entry->cost_key = costmodel_key(key, r->dynamic);
+        entry->cost_dynamic = r->dynamic;
+        entry->file_size_for_sff = r->dynamic ? -1 : r->size;
+    }
+    entry->expected_cost = costmodel_predict(entry->cost_key, entry->file_size_for_sff);
+}
+
+/**
+ * @brief Simula el servidor con la política activa (sched_init()).
+ * * Reproduce el bucle del maestro y de los trabajadores sobre eventos
+ * discretos: el maestro encola las llegadas en orden y, como en el
+ * servidor, se bloquea mientras el búfer está lleno (las llegadas esperan
+ * en la cola de accept); cada trabajador libre extrae con la política y
+ * queda ocupado durante el tiempo de servicio de la petición. No hay hilos
+ * reales: las funciones *_locked se llaman sin competencia.
+ */
+static void wsim_run(int num_threads) {
+    wsim_worker_t *workers = calloc(num_threads, sizeof(wsim_worker_t));
+    assert(workers != NULL);
+    int arrived = 0; // Peticiones cuya llegada ya ocurrió.
+    int enqueued = 0; // Peticiones que el maestro ya metió en el búfer.
+    int finished = 0;
+    double now = 0;
+
+    while (finished < request_count) {
+        int progress = 1;
+        while (progress) {
+            progress = 0;
+            while (enqueued < arrived && buffer_count_global < buffer_slots_global) {
+                request_entry_t entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.conn_fd = enqueued; // Índice de la petición en la traza.
+                // El peek del servidor ve el tamaño del ejecutable de un CGI,
+                // no el de su respuesta, que es lo que guarda la traza.
+                entry.file_size_for_sff = requests[enqueued].size;
+                if (requests[enqueued].dynamic && requests[enqueued].size >= 0 && cgi_peek_size >= 0) {
+                    entry.file_size_for_sff = cgi_peek_size;
+                }
+                entry.req_class = requests[enqueued].dynamic ? REQ_CLASS_DYNAMIC : REQ_CLASS_STATIC;
+                if (sched_policy->peek == SCHED_PEEK_COST) {
+                    wsim_estimate_cost(&entry, &requests[enqueued]);
+                }
+                enqueue_request_locked(&entry);
+                enqueued++;
+                progress = 1;
+            }
+            for (int w = 0; w < num_threads && requests_available_locked(); w++) {
+                if (workers[w].busy) {
+                    continue;
+                }
+                dequeue_request_locked(&workers[w].entry);
+                wsim_request_t *r = &requests[workers[w].entry.conn_fd];
+                r->start = now;
+                workers[w].busy = 1;
+                workers[w].busy_until = now + r->service;
+                progress = 1;
+            }
+        }
+
+        // Siguiente evento: una llegada o el fin de un servicio (primero los fines).
+        int next_worker = -1;
+        double next_time = arrived < request_count ? requests[arrived].arrival : DBL_MAX;
+        for (int w = 0; w < num_threads; w++) {
+            if (workers[w].busy && workers[w].busy_until <= next_time) {
+                next_time = workers[w].busy_until;
+                next_worker = w;
+            }
+        }
+        now = next_time;
+        if (next_worker < 0) {
+            arrived++;
+            continue;
+        }
+        wsim_worker_t *wk = &workers[next_worker];
+        requests[wk->entry.conn_fd].finish = now;
+        if (wk->entry.cost_key != 0) {
+            costmodel_observe(wk->entry.cost_key, wk->entry.file_size_for_sff, wk->entry.cost_dynamic, requests[wk->entry.conn_fd].service);
+        }
+        wk->busy = 0;
+        if (wk->entry.req_class >= 0) {
+            release_request_locked(&wk->entry);
+        }
+        finished++;
+    }
+    free(workers);
+}
+
+/**
+ * @brief Imprime las métricas de las peticiones que cumplen un filtro.
+ *
+ * @param policy El nombre de la política simulada.
+ * @param label La etiqueta de la fila.
+ * @param dynamic 0 estáticas, 1 dinámicas, -1 todas.
+ * @param starve_slowdown Umbral de slowdown a partir del cual una petición
+ * se considera postergada.
+ */
+static void wsim_report(const char *policy, const char *label, int dynamic, double starve_slowdown) {
+    double *response = malloc(sizeof(double) * request_count);
+    double *slowdown = malloc(sizeof(double) * request_count);
+    assert(response != NULL && slowdown != NULL);
+    double sum_response = 0, sum_slowdown = 0, max_wait = 0;
+    int n = 0, starved = 0;
+
+    for (int i = 0; i < request_count; i++) {
+        wsim_request_t *r = &requests[i];
+        if (dynamic >= 0 && r->dynamic != dynamic) {
+            continue;
+        }
+        response[n] = r->finish - r->arrival;
+        // Un servicio de menos de 1 us no debe disparar el slowdown.
+        slowdown[n] = response[n] / (r->service > 1 ? r->service : 1);
+        sum_response += response[n];
+        sum_slowdown += slowdown[n];
+        if (r->start - r->arrival > max_wait) {
+            max_wait = r->start - r->arrival;
+        }
+        starved += slowdown[n] > starve_slowdown;
+        n++;
+    }
+    if (n > 0) {
+        qsort(response, n, sizeof(double), compare_double);
+        qsort(slowdown, n, sizeof(double), compare_double);
+        int p99 = (int)((n - 1) * 0.99);
+        printf("%-6s %-10s %8d %12.2f %12.2f %10.1f %10.1f %12.2f %8.2f%%\n", policy, label, n,
+               sum_response / n / 1000, response[p99] / 1000, sum_slowdown / n, slowdown[p99], max_wait / 1000,
+               100.0 * starved / n);
+    }
+    free(response);
+    free(slowdown);
+}
+
+/**
+ * @brief Función principal de wsim.
+ * * Simulador de eventos discretos para comparar las políticas de
+ * planificación sin levantar el servidor. Reproduce una traza de peticiones
+ * (la binaria que escribe "wserver -T" o una de texto) con -t trabajadores
+ * y -b huecos de búfer, usando el mismo código de sched.c que el servidor,
+ * y muestra para cada política el tiempo de respuesta medio y p99, el
+ * slowdown (respuesta / servicio), la espera máxima en cola y el porcentaje
+ * de peticiones postergadas (slowdown mayor que -x). Con -g los CGI entran
+ * en SFF con el tamaño de su ejecutable, como en el servidor.
+ *
+ * @param argc El número de argumentos.
+ * @param argv El vector de argumentos.
+ * @return 0 en caso de éxito.
+ */
+int main(int argc, char *argv[]) {
+    int num_threads = 1, num_buffers = 1, weight_static = 1, weight_dynamic = 1, max_dynamic_workers = 0;
+    double starve_slowdown = 10;
+    char *policies = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:b:s:w:c:x:g:")) != -1) {
+        switch (c) {
+        case 't':
+            num_threads = atoi(optarg);
+            break;
+        case 'b':
+            num_buffers = atoi(optarg);
+            break;
+        case 's':
+            policies = optarg;
+            break;
+        case 'w':
+            if (sscanf(optarg, "%d:%d", &weight_static, &weight_dynamic) != 2) {
+                weight_static = weight_dynamic = 0;
+            }
+            break;
+        case 'c':
+            max_dynamic_workers = atoi(optarg);
+            break;
+        case 'x':
+            starve_slowdown = atof(optarg);
+            break;
+        case 'g':
+            cgi_peek_size = atoll(optarg);
+            if (cgi_peek_size < 0) {
+                optind = argc;
+            }
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 1 || num_threads <= 0 || num_buffers <= 0 || weight_static <= 0 || weight_dynamic <= 0 ||
+        max_dynamic_workers < 0 || starve_slowdown <= 0) {
+        fprintf(stderr, "Uso: wsim [-t threads] [-b buffers] [-s FIFO,SFF,...] [-w estatico:dinamico] "
+                        "[-c maxcgi] [-x slowdown] [-g cgibytes] <traza>\n");
+        exit(1);
+    }
+
+    const char *path = argv[optind];
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        perror(path);
+        exit(1);
+    }
+    char magic[sizeof(((trace_file_header_t *)0)->magic)];
+    if (fread(magic, sizeof(magic), 1, in) == 1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+        rewind(in);
+        wsim_load_trace(in, path);
+    } else {
+        rewind(in);
+        wsim_load_text(in, path);
+    }
+    fclose(in);
+    if (request_count == 0) {
+        fprintf(stderr, "%s no contiene peticiones\n", path);
+        exit(1);
+    }
+    qsort(requests, request_count, sizeof(wsim_request_t), compare_arrival);
+    double first = requests[0].arrival;
+    for (int i = 0; i < request_count; i++) {
+        requests[i].arrival -= first;
+    }
+
+    printf("%s: %d peticiones, %d hilos, %d huecos\n", path, request_count, num_threads, num_buffers);
+    if (cgi_peek_size < 0) {
+        printf("Aproximación: SFF ordena los CGI por el tamaño de su respuesta; con -g se usa el del ejecutable, "
+               "como en el servidor.\n");
+    }
+    printf("%-6s %-10s %8s %12s %12s %10s %10s %12s %9s\n", "-s", "tipo", "n", "resp. ms", "p99 ms",
+           "slowdown", "p99 sd", "espera max", "> -x");
+
+    // Sin -s se comparan todas las políticas.
+    char all[MAXBUF] = "";
+    if (policies == NULL) {
+        for (int i = 0; sched_policies[i] != NULL; i++) {
+            strncat(all, i ? "," : "", sizeof(all) - strlen(all) - 1);
+            strncat(all, sched_policies[i]->name, sizeof(all) - strlen(all) - 1);
+        }
+        policies = all;
+    }
+    for (char *name = strtok(policies, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (sched_init(name, num_buffers, num_threads, weight_static, weight_dynamic, max_dynamic_workers) < 0) {
+            exit(1);
+        }
+        costmodel_init();
+        wsim_run(num_threads);
+        wsim_report(name, "all", -1, starve_slowdown);
+        wsim_report(name, "static", 0, starve_slowdown);
+        wsim_report(name, "cgi", 1, starve_slowdown);
+        sched_destroy();
+    }
+    return 0;
+}
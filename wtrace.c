@@ -0,0 +1,196 @@
+#include "io_helper.h"
+#include "trace.h"
+
+static const char *stage_names[TRACE_NUM_STAGES] = {
+    "accept", "peek", "enqueue", "dequeue", "headers", "stat", "first byte", "last byte", "close",
+};
+
+// Estadísticas de un intervalo de tiempo entre dos etapas.
+typedef struct {
+    double *samples; // Microsegundos.
+    int count;
+} wtrace_series_t;
+
+static trace_record_t *records;
+static int record_count;
+
+/**
+ * @brief Añade una muestra en microsegundos a una serie.
+ */
+static void series_add(wtrace_series_t *s, uint64_t from, uint64_t to) {
+    s->samples[s->count++] = (to - from) / 1000.0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Media de una serie (0 si está vacía).
+ */
+static double series_mean(const wtrace_series_t *s) {
+    double sum = 0;
+    for (int i = 0; i < s->count; i++) {
+        sum += s->samples[i];
+    }
+    return s->count ? sum / s->count : 0;
+}
+
+/**
+ * @brief Imprime una fila con n, media, p50, p99 y máximo de una serie.
+ */
+static void series_print(const char *label, wtrace_series_t *s) {
+    if (s->count == 0) {
+        printf("  %-28s %8d\n", label, 0);
+        return;
+    }
+    qsort(s->samples, s->count, sizeof(double), compare_double);
+    printf("  %-28s %8d %12.1f %12.1f %12.1f %12.1f\n", label, s->count, series_mean(s),
+           s->samples[s->count / 2], s->samples[(int)((s->count - 1) * 0.99)], s->samples[s->count - 1]);
+}
+
+/**
+ * @brief Imprime el desglose por etapas de los registros que cumplen un filtro.
+ * * Cada etapa se mide desde la etapa anterior que la petición alcanzó, así
+ * que las etapas omitidas (peek en FIFO, stat en un error) no generan huecos.
+ *
+ * @param title El título de la sección.
+ * @param mask Bits de flags que se comparan.
+ * @param value Valor que deben tener esos bits.
+ */
+static void report(const char *title, uint32_t mask, uint32_t value) {
+    wtrace_series_t stages[TRACE_NUM_STAGES], wait_buffer, queue, service, total;
+    wtrace_series_t *all[TRACE_NUM_STAGES + 4];
+    int n = 0;
+
+    for (int i = 0; i < TRACE_NUM_STAGES; i++) {
+        all[n++] = &stages[i];
+    }
+    all[n++] = &wait_buffer;
+    all[n++] = &queue;
+    all[n++] = &service;
+    all[n++] = &total;
+    for (int i = 0; i < n; i++) {
+        all[i]->samples = malloc(sizeof(double) * (record_count + 1));
+        assert(all[i]->samples != NULL);
+        all[i]->count = 0;
+    }
+
+    int matched = 0;
+    for (int r = 0; r < record_count; r++) {
+        trace_record_t *rec = &records[r];
+        if ((rec->flags & mask) != value) {
+            continue;
+        }
+        matched++;
+        int prev = TRACE_ACCEPT;
+        for (int i = TRACE_ACCEPT + 1; i < TRACE_NUM_STAGES; i++) {
+            if (rec->ts[i] == 0) {
+                continue;
+            }
+            series_add(&stages[i], rec->ts[prev], rec->ts[i]);
+            prev = i;
+        }
+        uint64_t before_enqueue = rec->ts[TRACE_PEEK] ? rec->ts[TRACE_PEEK] : rec->ts[TRACE_ACCEPT];
+        if (rec->ts[TRACE_ENQUEUE]) {
+            series_add(&wait_buffer, before_enqueue, rec->ts[TRACE_ENQUEUE]);
+        }
+        if (rec->ts[TRACE_ENQUEUE] && rec->ts[TRACE_DEQUEUE]) {
+            series_add(&queue, rec->ts[TRACE_ENQUEUE], rec->ts[TRACE_DEQUEUE]);
+        }
+        if (rec->ts[TRACE_DEQUEUE] && rec->ts[TRACE_CLOSE]) {
+            series_add(&service, rec->ts[TRACE_DEQUEUE], rec->ts[TRACE_CLOSE]);
+            series_add(&total, rec->ts[TRACE_ACCEPT], rec->ts[TRACE_CLOSE]);
+        }
+    }
+
+    if (matched > 0) {
+        printf("\n%s: %d peticiones\n", title, matched);
+        printf("  %-28s %8s %12s %12s %12s %12s\n", "etapa (us desde la anterior)", "n", "media", "p50", "p99", "max");
+        for (int i = TRACE_ACCEPT + 1; i < TRACE_NUM_STAGES; i++) {
+            char label[64];
+            snprintf(label, sizeof(label), "-> %s", stage_names[i]);
+            series_print(label, &stages[i]);
+        }
+        printf("  %-28s\n", "resumen (us)");
+        double mean_wait = series_mean(&wait_buffer), mean_queue = series_mean(&queue);
+        double mean_service = series_mean(&service), mean_total = series_mean(&total);
+        series_print("espera por búfer lleno", &wait_buffer);
+        series_print("cola (enqueue -> dequeue)", &queue);
+        series_print("servicio (dequeue -> close)", &service);
+        series_print("total (accept -> close)", &total);
+
+        if (mean_total > 0) {
+            printf("  Diagnóstico: búfer lleno %.0f%%, cola %.0f%%, servicio %.0f%% del tiempo total medio.\n",
+                   100 * mean_wait / mean_total, 100 * mean_queue / mean_total, 100 * mean_service / mean_total);
+            if (mean_wait > mean_service) {
+                printf("  El maestro espera a que haya hueco en el búfer: faltan hilos (-t) o el búfer (-b) es pequeño.\n");
+            } else if (mean_queue > mean_service) {
+                printf("  Las peticiones pasan más tiempo en cola que en servicio: faltan hilos (-t) o la política las retrasa.\n");
+            } else {
+                printf("  Domina el tiempo de servicio: el cuello de botella está en atender cada petición, no en la cola.\n");
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        free(all[i]->samples);
+    }
+}
+
+/**
+ * @brief Función principal de wtrace.
+ * * Lee un archivo de trazas escrito por el servidor con -T y muestra el
+ * desglose de latencia por etapa, separando la espera en cola del tiempo de
+ * servicio, para todas las peticiones y por tipo de contenido.
+ *
+ * @param argc El número de argumentos.
+ * @param argv El vector de argumentos.
+ * @return 0 en caso de éxito.
+ */
+int main(int argc, char *argv[]) {
+    trace_file_header_t hdr;
+
+    if (argc != 2) {
+        fprintf(stderr, "Uso: wtrace <trace.bin>\n");
+        exit(1);
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.num_stages != TRACE_NUM_STAGES || hdr.record_size != sizeof(trace_record_t)) {
+        fprintf(stderr, "%s no es un archivo de trazas compatible\n", argv[1]);
+        exit(1);
+    }
+
+    int capacity = 1024;
+    records = malloc(sizeof(trace_record_t) * capacity);
+    assert(records != NULL);
+    while (fread(&records[record_count], sizeof(trace_record_t), 1, in) == 1) {
+        if (++record_count == capacity) {
+            capacity *= 2;
+            records = realloc(records, sizeof(trace_record_t) * capacity);
+            assert(records != NULL);
+        }
+    }
+    fclose(in);
+
+    int chunked = 0, tls = 0, handoff = 0;
+    for (int i = 0; i < record_count; i++) {
+        chunked += (records[i].flags & TRACE_F_CHUNKED) != 0;
+        tls += (records[i].flags & TRACE_F_TLS) != 0;
+        handoff += (records[i].flags & TRACE_F_HANDOFF) != 0;
+    }
+    printf("%s: %d registros (%d por partes, %d HTTPS, %d pasadas a HTTP/2)\n", argv[1], record_count, chunked,
+           tls, handoff);
+
+    report("Todas", 0, 0);
+    report("Estáticas", TRACE_F_DYNAMIC, 0);
+    report("Dinámicas (CGI)", TRACE_F_DYNAMIC, TRACE_F_DYNAMIC);
+    free(records);
+    return 0;
+}
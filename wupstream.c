@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include "io_helper.h"
+#include <pthread.h>
+
+#define MAXBUF (8192)
+#define MAXBODY (65536) // Cuerpo máximo que se devuelve en la respuesta.
+#define SLOW_DELAY_S (2) // Espera de las URIs que contienen "/slow".
+
+static int next_conn_id; // Identificador de la siguiente conexión aceptada (atómico).
+
+/**
+ * @brief Lee un cuerpo con Transfer-Encoding: chunked y lo decodifica.
+ *
+ * @param fd La conexión con el proxy.
+ * @param body Búfer de salida (MAXBODY); lo que no cabe se descarta.
+ * @return Los bytes guardados en body, o -1 si la conexión se cerró o el
+ * formato no es válido.
+ */
+static int read_chunked(int fd, char *body) {
+    char line[MAXBUF];
+    int len = 0;
+
+    while (1) {
+        if (readline(fd, line, sizeof(line)) <= 0) {
+            return -1;
+        }
+        long size = strtol(line, NULL, 16);
+        if (size < 0) {
+            return -1;
+        }
+        if (size == 0) {
+            break;
+        }
+        while (size > 0) {
+            char c;
+            if (read(fd, &c, 1) != 1) {
+                return -1;
+            }
+            if (len < MAXBODY) {
+                body[len++] = c;
+            }
+            size--;
+        }
+        // CRLF tras los datos del fragmento.
+        if (readline(fd, line, sizeof(line)) <= 0) {
+            return -1;
+        }
+    }
+    // Trailers, hasta la línea vacía.
+    do {
+        if (readline(fd, line, sizeof(line)) <= 0) {
+            return -1;
+        }
+    } while (strcmp(line, "\r\n") != 0 && strcmp(line, "\n") != 0);
+    return len;
+}
+
+/**
+ * @brief Atiende las peticiones de una conexión keep-alive hasta que el
+ * proxy la cierra.
+ * * Cada respuesta indica la conexión y el número de petición dentro de ella,
+ * de modo que una prueba puede comprobar si el proxy la reutilizó, y repite
+ * el método, la URI y el cuerpo recibido.
+ */
+static void *connection_routine(void *arg) {
+    int fd = (int)(long)arg;
+    int conn_id = __atomic_add_fetch(&next_conn_id, 1, __ATOMIC_RELAXED);
+    char line[MAXBUF], method[MAXBUF], uri[MAXBUF], head[MAXBUF];
+    static __thread char body[MAXBODY], resp[MAXBODY + MAXBUF];
+
+    for (int req = 1;; req++) {
+        if (readline(fd, line, sizeof(line)) <= 0 || sscanf(line, "%s %s", method, uri) != 2) {
+            break;
+        }
+        long content_length = 0;
+        int chunked = 0;
+        while (readline(fd, line, sizeof(line)) > 0 && strcmp(line, "\r\n") != 0 && strcmp(line, "\n") != 0) {
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                content_length = atol(line + 15);
+            } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line, "chunked")) {
+                chunked = 1;
+            }
+        }
+
+        int body_len = 0;
+        if (chunked) {
+            body_len = read_chunked(fd, body);
+            if (body_len < 0) {
+                break;
+            }
+        } else if (content_length > 0) {
+            if (content_length > MAXBODY) {
+                break;
+            }
+            while (body_len < content_length) {
+                ssize_t n = read(fd, body + body_len, content_length - body_len);
+                if (n <= 0) {
+                    break;
+                }
+                body_len += n;
+            }
+        }
+
+        if (strstr(uri, "/slow")) {
+            sleep(SLOW_DELAY_S);
+        }
+        int resp_len = snprintf(resp, MAXBUF, "conn=%d req=%d %s %s body=", conn_id, req, method, uri);
+        memcpy(resp + resp_len, body, body_len);
+        resp_len += body_len;
+        int head_len = snprintf(head, sizeof(head), ""
+                                "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: text/plain\r\n"
+                                "Content-Length: %d\r\n"
+                                "Connection: keep-alive\r\n\r\n", resp_len);
+        if (write(fd, head, head_len) != head_len || write(fd, resp, resp_len) != resp_len) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+/**
+ * @brief Servidor de origen mínimo para probar el proxy inverso (-x).
+ * * @usage ./wupstream <port>
+ */
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Uso: %s <port>\n", argv[0]);
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int listen_fd = open_listen_fd_or_die(atoi(argv[1]));
+    printf("Servidor de origen de prueba en el puerto %s\n", argv[1]);
+    fflush(stdout);
+
+    while (1) {
+        int conn_fd = accept(listen_fd, NULL, NULL);
+        if (conn_fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_routine, (void *)(long)conn_fd) != 0) {
+            close(conn_fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}